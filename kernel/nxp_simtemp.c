@@ -3,170 +3,1513 @@
 #include <linux/kernel.h>
 #include <linux/fs.h>
 #include <linux/of.h>
+#include <linux/property.h>
+#include <linux/idr.h>
 #include <linux/random.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include <linux/device.h>
 #include <linux/poll.h>
+#include <linux/log2.h>
+#include <linux/fixp-arith.h>
+#include <linux/cpumask.h>
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/smp.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "nxp_simtemp.h"
 
-static struct nxp_simtemp_dev *gdev;
+#define CREATE_TRACE_POINTS
+#include "nxp_simtemp_trace.h"
+
+static unsigned int num_sensors = 1;
+module_param(num_sensors, uint, 0444);
+MODULE_PARM_DESC(num_sensors, "Number of simulated sensors, /dev/simtemp0..N-1 when > 1 (default 1)");
+
+static bool percpu;
+module_param(percpu, bool, 0444);
+MODULE_PARM_DESC(percpu, "One sensor per online CPU, each pinned to its CPU; overrides num_sensors");
+
+/*
+ * Per-sensor start-up configuration, applied in probe() before the first
+ * sample: entry N configures sensor N (simtempN, or the CPU number with
+ * percpu=1, or the device tree instance number) and a single value
+ * applies to every sensor. Device tree properties take precedence.
+ */
+static unsigned int buffer_size_param[SIMTEMP_MAX_SENSORS] = { SIMTEMP_DEFAULT_BUF_SIZE };
+static unsigned int nr_buffer_size;
+module_param_array_named(buffer_size, buffer_size_param, uint, &nr_buffer_size, 0444);
+MODULE_PARM_DESC(buffer_size, "Ring buffer size in samples, rounded up to a power of two (default 64)");
+
+static unsigned long sampling_ns_param[SIMTEMP_MAX_SENSORS];
+static unsigned int nr_sampling_ns;
+module_param_array_named(sampling_ns, sampling_ns_param, ulong, &nr_sampling_ns, 0444);
+MODULE_PARM_DESC(sampling_ns, "Sampling period in ns (default 1000000000)");
+
+static int threshold_mC_param[SIMTEMP_MAX_SENSORS];
+static unsigned int nr_threshold_mC;
+module_param_array_named(threshold_mC, threshold_mC_param, int, &nr_threshold_mC, 0444);
+MODULE_PARM_DESC(threshold_mC, "Alert threshold in m°C, also used as threshold_low_mC (default 45000)");
+
+static char *mode_param[SIMTEMP_MAX_SENSORS];
+static unsigned int nr_mode;
+module_param_array_named(mode, mode_param, charp, &nr_mode, 0444);
+MODULE_PARM_DESC(mode, "Temperature mode, as the mode attribute (default normal)");
+
+static int cpu_param[SIMTEMP_MAX_SENSORS];
+static unsigned int nr_cpu;
+module_param_array_named(cpu, cpu_param, int, &nr_cpu, 0444);
+MODULE_PARM_DESC(cpu, "CPU to pin the producer to, -1 = any (default -1, own CPU with percpu=1)");
+
+/* Device tree instances are numbered after the percpu ones, if any */
+static DEFINE_IDA(simtemp_dt_ida);
+
+static void simtemp_timer_start(struct nxp_simtemp_dev *dev);
+static void simtemp_producer_stop(struct nxp_simtemp_dev *dev);
+static int simtemp_ring_alloc(struct nxp_simtemp_dev *dev, unsigned int nr);
+static void simtemp_set_mode(struct nxp_simtemp_dev *dev, enum simtemp_mode mode);
+static void simtemp_seed(struct nxp_simtemp_dev *dev, u64 seed);
+static void simtemp_replay(struct nxp_simtemp_dev *dev, ktime_t ts);
 
 /* ============================================================
  *                 SYSFS ATTRIBUTE HANDLERS
  * ============================================================
- * Each handler allows user-space to read or modify driver
- * configuration via /sys/class/misc/simtemp/
+ * Each handler allows user-space to read or modify the
+ * configuration of one sensor via /sys/class/misc/<name>/
  * Attributes:
- *   - sampling_ms
+ *   - sampling_ms  (compatibility view of sampling_ns)
+ *   - sampling_ns
+ *   - running      (1 = sampling, 0 = stopped)
  *   - threshold_mC
+ *   - threshold_low_mC (alert hysteresis)
  *   - mode
- *   - stats
+ *   - seed         (PRNG seed; writing it restarts the generators)
+ *   - waveform     (key=value parameters of the waveform modes)
+ *   - lut          (binary: s32 mC lookup table for the lut mode)
+ *   - replay_speed (playback speed of a trace written to /dev/<name>)
+ *   - gen_context  (workqueue, highpri, hrtimer)
+ *   - cpu          (CPU the producer is pinned to, -1 = any)
+ *   - batch        (samples generated per timer expiry)
+ *   - wakeup_watermark / wakeup_timeout_ns
+ *   - agg_window_ns (window of the aggregated stream)
+ *   - buffer_size
+ *   - stats        (text) / stats_bin (binary struct simtemp_stats)
  * ============================================================ */
 
+/* The attributes live on the misc device, whose drvdata is the miscdevice */
+static inline struct nxp_simtemp_dev *to_simtemp_dev(struct kobject *kobj)
+{
+    struct miscdevice *misc = dev_get_drvdata(kobj_to_dev(kobj));
+
+    return container_of(misc, struct nxp_simtemp_dev, misc);
+}
+
+/* A new period restarts the timer, so it applies from now rather than
+ * after the expiry already programmed with the old one. The first sample
+ * generated with it carries SIMTEMP_FLAG_RESTART. */
+static void simtemp_set_period(struct nxp_simtemp_dev *dev, ktime_t period)
+{
+    mutex_lock(&dev->cfg_lock);
+    simtemp_producer_stop(dev);
+    WRITE_ONCE(dev->period, period);
+    if (dev->running)
+        simtemp_timer_start(dev);
+    mutex_unlock(&dev->cfg_lock);
+}
+
+/* Periods below 1 ms read back as 0 here; use sampling_ns for those */
 static ssize_t sampling_ms_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
 {
-    return sprintf(buf, "%u\n", gdev->sampling_ms);
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%lld\n", ktime_to_ms(READ_ONCE(dev->period)));
 }
 
 static ssize_t sampling_ms_store(struct kobject *kobj, struct kobj_attribute *attr,
                                  const char *buf, size_t count)
 {
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
     unsigned int val;
     if (kstrtouint(buf, 10, &val))
         return -EINVAL;
     if (val == 0)
         return -EINVAL;
-    gdev->sampling_ms = val;
+    simtemp_set_period(dev, ms_to_ktime(val));
+    return count;
+}
+
+static ssize_t sampling_ns_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%lld\n", ktime_to_ns(READ_ONCE(dev->period)));
+}
+
+static ssize_t sampling_ns_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    u64 val;
+    if (kstrtou64(buf, 10, &val))
+        return -EINVAL;
+    if (val < SIMTEMP_MIN_PERIOD_NS || val > KTIME_MAX)
+        return -EINVAL;
+    simtemp_set_period(dev, ns_to_ktime(val));
+    return count;
+}
+
+static ssize_t running_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%d\n", READ_ONCE(dev->running));
+}
+
+/* 0 stops sampling (the ring, readers and configuration are kept), 1
+ * restarts it with a fresh timer */
+static ssize_t running_store(struct kobject *kobj, struct kobj_attribute *attr,
+                             const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    bool val;
+    if (kstrtobool(buf, &val))
+        return -EINVAL;
+
+    mutex_lock(&dev->cfg_lock);
+    if (val != dev->running) {
+        WRITE_ONCE(dev->running, val);
+        if (val)
+            simtemp_timer_start(dev);
+        else
+            simtemp_producer_stop(dev);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    return count;
+}
+
+static ssize_t threshold_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%d\n", READ_ONCE(dev->threshold_mC));
+}
+
+static ssize_t threshold_mC_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                  const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    s32 val;
+    if (kstrtos32(buf, 10, &val))
+        return -EINVAL;
+    WRITE_ONCE(dev->threshold_mC, val);
+    return count;
+}
+
+static const char * const simtemp_mode_names[] = {
+    [SIMTEMP_MODE_NORMAL] = "normal",
+    [SIMTEMP_MODE_NOISY]  = "noisy",
+    [SIMTEMP_MODE_RAMP]   = "ramp",
+    [SIMTEMP_MODE_SINE]     = "sine",
+    [SIMTEMP_MODE_STEP]     = "step",
+    [SIMTEMP_MODE_RC]       = "rc",
+    [SIMTEMP_MODE_GAUSSIAN] = "gaussian",
+    [SIMTEMP_MODE_LUT]      = "lut",
+    [SIMTEMP_MODE_REPLAY]   = "replay",
+};
+
+static ssize_t threshold_low_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%d\n", READ_ONCE(dev->threshold_low_mC));
+}
+
+/* Values above threshold_mC behave like threshold_mC (no hysteresis) */
+static ssize_t threshold_low_mC_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                      const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    s32 val;
+    if (kstrtos32(buf, 10, &val))
+        return -EINVAL;
+    WRITE_ONCE(dev->threshold_low_mC, val);
+    return count;
+}
+
+static ssize_t mode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%s\n", simtemp_mode_names[READ_ONCE(dev->mode)]);
+}
+
+static ssize_t mode_store(struct kobject *kobj, struct kobj_attribute *attr,
+                          const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    int mode = sysfs_match_string(simtemp_mode_names, buf);
+
+    /* Accept only valid mode strings */
+    if (mode < 0)
+        return -EINVAL;
+
+    /* Entering replay rewinds the trace, which the producer owns */
+    if (mode == SIMTEMP_MODE_REPLAY) {
+        mutex_lock(&dev->cfg_lock);
+        simtemp_producer_stop(dev);
+        simtemp_set_mode(dev, mode);
+        if (dev->running)
+            simtemp_timer_start(dev);
+        mutex_unlock(&dev->cfg_lock);
+    } else {
+        simtemp_set_mode(dev, mode);
+    }
+    return count;
+}
+
+static ssize_t seed_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%llu\n", READ_ONCE(dev->seed));
+}
+
+/* Re-seeding resets the generator state, so the same seed and
+ * configuration reproduce the same temperature sequence. The producer
+ * owns that state, so it is stopped around the reset. */
+static ssize_t seed_store(struct kobject *kobj, struct kobj_attribute *attr,
+                          const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    u64 val;
+
+    if (kstrtou64(buf, 0, &val))
+        return -EINVAL;
+
+    mutex_lock(&dev->cfg_lock);
+    simtemp_producer_stop(dev);
+    simtemp_seed(dev, val);
+    if (dev->running)
+        simtemp_timer_start(dev);
+    mutex_unlock(&dev->cfg_lock);
     return count;
 }
 
-static ssize_t threshold_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+static ssize_t waveform_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    struct simtemp_wave_cfg w;
+    u32 lut_len;
+
+    mutex_lock(&dev->cfg_lock);
+    w = dev->wave;
+    lut_len = dev->lut_len;
+    mutex_unlock(&dev->cfg_lock);
+
+    return sprintf(buf, "base_mC=%d amplitude_mC=%d period=%u tau=%u noise_mC=%d lut_len=%u\n",
+                   w.base_mC, w.amplitude_mC, w.period, w.tau, w.noise_mC, lut_len);
+}
+
+/* Accepts any subset of "key=value" pairs, e.g. "amplitude_mC=2000 period=500".
+ * The update is applied as a whole with the producer stopped. */
+static ssize_t waveform_store(struct kobject *kobj, struct kobj_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    struct simtemp_wave_cfg w;
+    char *str, *p, *tok, *val;
+    int ret = 0;
+
+    str = kstrndup(buf, count, GFP_KERNEL);
+    if (!str)
+        return -ENOMEM;
+
+    mutex_lock(&dev->cfg_lock);
+    w = dev->wave;
+    p = strim(str);
+    while (!ret && (tok = strsep(&p, " \t\n")) != NULL) {
+        if (!*tok)
+            continue;
+        val = strchr(tok, '=');
+        if (!val) {
+            ret = -EINVAL;
+            break;
+        }
+        *val++ = '\0';
+        if (!strcmp(tok, "base_mC"))
+            ret = kstrtos32(val, 10, &w.base_mC);
+        else if (!strcmp(tok, "amplitude_mC"))
+            ret = kstrtos32(val, 10, &w.amplitude_mC);
+        else if (!strcmp(tok, "period"))
+            ret = kstrtou32(val, 10, &w.period);
+        else if (!strcmp(tok, "tau"))
+            ret = kstrtou32(val, 10, &w.tau);
+        else if (!strcmp(tok, "noise_mC"))
+            ret = kstrtos32(val, 10, &w.noise_mC);
+        else
+            ret = -EINVAL;
+    }
+    if (!ret && (w.period < 2 || w.period > SIMTEMP_MAX_WAVE_PERIOD ||
+                 w.tau == 0 || w.noise_mC < 0))
+        ret = -EINVAL;
+
+    if (!ret) {
+        simtemp_producer_stop(dev);
+        dev->wave = w;
+        if (dev->running)
+            simtemp_timer_start(dev);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    kfree(str);
+    return ret ? ret : count;
+}
+
+/* Binary lookup table: an array of s32 mC values that the lut mode plays
+ * back one entry per sample, looping. A write at offset 0 starts a new
+ * table; lut_len grows with every chunk written after it. Each chunk is
+ * copied with the producer stopped, like the other waveform parameters,
+ * so the generator never sees a half-written table. */
+static ssize_t lut_write(struct file *filp, struct kobject *kobj, struct bin_attribute *attr,
+                         char *buf, loff_t off, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    s32 *lut;
+
+    if (off % sizeof(s32) || count % sizeof(s32))
+        return -EINVAL;
+
+    mutex_lock(&dev->cfg_lock);
+    lut = dev->lut;
+    if (!lut) {
+        lut = vzalloc(SIMTEMP_MAX_LUT * sizeof(s32));
+        if (!lut) {
+            mutex_unlock(&dev->cfg_lock);
+            return -ENOMEM;
+        }
+    }
+
+    simtemp_producer_stop(dev);
+    dev->lut = lut;
+    if (off == 0)
+        dev->lut_len = 0;
+    memcpy((char *)lut + off, buf, count);
+    dev->lut_len = max_t(u32, dev->lut_len, (off + count) / sizeof(s32));
+    if (dev->running)
+        simtemp_timer_start(dev);
+    mutex_unlock(&dev->cfg_lock);
+    return count;
+}
+
+static ssize_t lut_read(struct file *filp, struct kobject *kobj, struct bin_attribute *attr,
+                        char *buf, loff_t off, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    size_t len;
+
+    mutex_lock(&dev->cfg_lock);
+    len = dev->lut ? dev->lut_len * sizeof(s32) : 0;
+    if (off >= len) {
+        count = 0;
+    } else {
+        count = min_t(size_t, count, len - off);
+        memcpy(buf, (char *)dev->lut + off, count);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    return count;
+}
+
+static ssize_t replay_speed_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%u\n", READ_ONCE(dev->replay_speed));
+}
+
+/* N plays the trace N times faster than recorded; 0 ignores the recorded
+ * timing and emits one batch of records per timer expiry */
+static ssize_t replay_speed_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                  const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    unsigned int val;
+    if (kstrtouint(buf, 10, &val))
+        return -EINVAL;
+
+    /* Restart the pass so the new speed applies from its first record */
+    mutex_lock(&dev->cfg_lock);
+    simtemp_producer_stop(dev);
+    WRITE_ONCE(dev->replay_speed, val);
+    dev->replay_pos = 0;
+    if (dev->running)
+        simtemp_timer_start(dev);
+    mutex_unlock(&dev->cfg_lock);
+    return count;
+}
+
+static const char * const simtemp_ctx_names[] = {
+    [SIMTEMP_CTX_WORKQUEUE] = "workqueue",
+    [SIMTEMP_CTX_HIGHPRI]   = "highpri",
+    [SIMTEMP_CTX_HRTIMER]   = "hrtimer",
+};
+
+static_assert(ARRAY_SIZE(simtemp_ctx_names) == SIMTEMP_CTX_COUNT);
+
+static ssize_t gen_context_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%s\n", simtemp_ctx_names[READ_ONCE(dev->ctx)]);
+}
+
+/* Switching context stops the timer and drains the work item, so the
+ * timer can be re-initialized in the hard/soft mode the new context needs. */
+static ssize_t gen_context_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    int ctx = sysfs_match_string(simtemp_ctx_names, buf);
+
+    if (ctx < 0)
+        return -EINVAL;
+
+    mutex_lock(&dev->cfg_lock);
+    if (ctx != dev->ctx) {
+        simtemp_producer_stop(dev);
+        WRITE_ONCE(dev->ctx, ctx);
+        if (dev->running)
+            simtemp_timer_start(dev);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    return count;
+}
+
+static ssize_t cpu_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%d\n", READ_ONCE(dev->cpu));
+}
+
+/* Re-pinning restarts the timer on the new CPU; -1 lets it run anywhere */
+static ssize_t cpu_store(struct kobject *kobj, struct kobj_attribute *attr,
+                         const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    int val;
+
+    if (kstrtoint(buf, 10, &val))
+        return -EINVAL;
+    if (val < -1 || val >= (int)nr_cpu_ids)
+        return -EINVAL;
+
+    /* cpus_read_lock() keeps the CPU online until the pin is in place
+     * (or the hotplug callback has seen it) */
+    cpus_read_lock();
+    if (val >= 0 && !cpu_online(val)) {
+        cpus_read_unlock();
+        return -EINVAL;
+    }
+    mutex_lock(&dev->cfg_lock);
+    dev->offline_cpu = -1;
+    if (val != dev->cpu) {
+        simtemp_producer_stop(dev);
+        WRITE_ONCE(dev->cpu, val);
+        if (dev->running)
+            simtemp_timer_start(dev);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    cpus_read_unlock();
+    return count;
+}
+
+static ssize_t batch_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%u\n", READ_ONCE(dev->batch));
+}
+
+/* Takes effect from the next timer expiry on */
+static ssize_t batch_store(struct kobject *kobj, struct kobj_attribute *attr,
+                           const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    unsigned int val;
+    if (kstrtouint(buf, 10, &val))
+        return -EINVAL;
+    if (val == 0 || val > SIMTEMP_MAX_BATCH)
+        return -EINVAL;
+    WRITE_ONCE(dev->batch, val);
+    return count;
+}
+
+static ssize_t wakeup_watermark_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%u\n", READ_ONCE(dev->wakeup_watermark));
+}
+
+/* Values above the ring size behave like the ring size */
+static ssize_t wakeup_watermark_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                      const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    unsigned int val;
+    if (kstrtouint(buf, 10, &val))
+        return -EINVAL;
+    if (val == 0 || val > SIMTEMP_MAX_BUF_SIZE)
+        return -EINVAL;
+    WRITE_ONCE(dev->wakeup_watermark, val);
+    return count;
+}
+
+static ssize_t wakeup_timeout_ns_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%lld\n", ktime_to_ns(READ_ONCE(dev->wakeup_timeout)));
+}
+
+static ssize_t wakeup_timeout_ns_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                       const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    u64 val;
+    if (kstrtou64(buf, 10, &val))
+        return -EINVAL;
+    if (val > KTIME_MAX)
+        return -EINVAL;
+    WRITE_ONCE(dev->wakeup_timeout, ns_to_ktime(val));
+    return count;
+}
+
+static ssize_t agg_window_ns_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%lld\n", ktime_to_ns(READ_ONCE(dev->agg_window)));
+}
+
+/* Takes effect from the next window on */
+static ssize_t agg_window_ns_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                   const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    u64 val;
+    if (kstrtou64(buf, 10, &val))
+        return -EINVAL;
+    if (val < SIMTEMP_MIN_PERIOD_NS || val > KTIME_MAX)
+        return -EINVAL;
+    WRITE_ONCE(dev->agg_window, ns_to_ktime(val));
+    return count;
+}
+
+static ssize_t buffer_size_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    return sprintf(buf, "%u\n", dev->buf_size);
+}
+
+/* Resizing replaces the ring, so sampling is stopped around the swap and
+ * the device must not be open (readers and mappings point into the ring). */
+static ssize_t buffer_size_store(struct kobject *kobj, struct kobj_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    unsigned int val;
+    int ret = 0;
+
+    if (kstrtouint(buf, 10, &val))
+        return -EINVAL;
+    if (val < SIMTEMP_MIN_BUF_SIZE || val > SIMTEMP_MAX_BUF_SIZE)
+        return -EINVAL;
+    val = roundup_pow_of_two(val);
+
+    mutex_lock(&dev->cfg_lock);
+    if (val != dev->buf_size) {
+        if (atomic_read(&dev->open_count)) {
+            ret = -EBUSY;
+        } else {
+            simtemp_producer_stop(dev);
+            ret = simtemp_ring_alloc(dev, val);
+            if (ret)
+                WRITE_ONCE(dev->stats.last_error, -ret);
+            if (dev->running)
+                simtemp_timer_start(dev);
+        }
+    }
+    mutex_unlock(&dev->cfg_lock);
+    return ret ? ret : count;
+}
+
+/* Snapshot of the counters. Each one is read atomically, without
+ * stopping the producer, so the set is not a single instant. */
+static void simtemp_get_stats(struct nxp_simtemp_dev *dev, struct simtemp_stats *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->updates = atomic64_read(&dev->stats.updates);
+    st->alerts = atomic64_read(&dev->stats.alerts);
+    st->missed = atomic64_read(&dev->stats.missed);
+    st->coalesced = atomic64_read(&dev->stats.coalesced);
+    st->dropped = atomic64_read(&dev->stats.dropped);
+    st->high_water = atomic_read(&dev->stats.high_water);
+    st->seq = READ_ONCE(dev->seq);
+    st->consumed = atomic64_read(&dev->stats.consumed);
+    st->wakeups = atomic64_read(&dev->stats.wakeups);
+    st->overruns = atomic64_read(&dev->stats.overruns);
+    st->lat_min_ns = atomic64_read(&dev->stats.lat_min_ns);
+    st->lat_max_ns = atomic64_read(&dev->stats.lat_max_ns);
+    st->last_error = READ_ONCE(dev->stats.last_error);
+}
+
+/* Read-only system statistics: updates, alerts, errors and lost ticks */
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    struct simtemp_stats st;
+
+    simtemp_get_stats(dev, &st);
+    return sprintf(buf, "updates=%llu alerts=%llu last_error=%u missed=%llu coalesced=%llu "
+                   "dropped=%llu high_water=%llu consumed=%llu wakeups=%llu overruns=%llu "
+                   "lat_min_ns=%llu lat_max_ns=%llu\n",
+                   st.updates, st.alerts, st.last_error, st.missed, st.coalesced,
+                   st.dropped, st.high_water, st.consumed, st.wakeups, st.overruns,
+                   st.lat_min_ns, st.lat_max_ns);
+}
+
+/* The same counters as one struct simtemp_stats, for scrapers that want
+ * them in a single read() without opening the device */
+static ssize_t stats_bin_read(struct file *filp, struct kobject *kobj, struct bin_attribute *attr,
+                              char *buf, loff_t off, size_t count)
+{
+    struct nxp_simtemp_dev *dev = to_simtemp_dev(kobj);
+    struct simtemp_stats st;
+
+    if (off >= sizeof(st))
+        return 0;
+    simtemp_get_stats(dev, &st);
+    count = min_t(size_t, count, sizeof(st) - off);
+    memcpy(buf, (char *)&st + off, count);
+    return count;
+}
+
+/* Sysfs attributes registration */
+static struct kobj_attribute sampling_ms_attr = __ATTR(sampling_ms, 0664, sampling_ms_show, sampling_ms_store);
+static struct kobj_attribute sampling_ns_attr = __ATTR(sampling_ns, 0664, sampling_ns_show, sampling_ns_store);
+static struct kobj_attribute running_attr = __ATTR(running, 0664, running_show, running_store);
+static struct kobj_attribute threshold_mC_attr = __ATTR(threshold_mC, 0664, threshold_mC_show, threshold_mC_store);
+static struct kobj_attribute threshold_low_mC_attr = __ATTR(threshold_low_mC, 0664, threshold_low_mC_show, threshold_low_mC_store);
+static struct kobj_attribute mode_attr = __ATTR(mode, 0664, mode_show, mode_store);
+static struct kobj_attribute seed_attr = __ATTR(seed, 0664, seed_show, seed_store);
+static struct kobj_attribute waveform_attr = __ATTR(waveform, 0664, waveform_show, waveform_store);
+static struct kobj_attribute replay_speed_attr = __ATTR(replay_speed, 0664, replay_speed_show, replay_speed_store);
+static struct kobj_attribute gen_context_attr = __ATTR(gen_context, 0664, gen_context_show, gen_context_store);
+static struct kobj_attribute cpu_attr = __ATTR(cpu, 0664, cpu_show, cpu_store);
+static struct kobj_attribute batch_attr = __ATTR(batch, 0664, batch_show, batch_store);
+static struct kobj_attribute wakeup_watermark_attr = __ATTR(wakeup_watermark, 0664, wakeup_watermark_show, wakeup_watermark_store);
+static struct kobj_attribute wakeup_timeout_ns_attr = __ATTR(wakeup_timeout_ns, 0664, wakeup_timeout_ns_show, wakeup_timeout_ns_store);
+static struct kobj_attribute agg_window_ns_attr = __ATTR(agg_window_ns, 0664, agg_window_ns_show, agg_window_ns_store);
+static struct kobj_attribute buffer_size_attr = __ATTR(buffer_size, 0664, buffer_size_show, buffer_size_store);
+static struct kobj_attribute stats_attr = __ATTR(stats, 0444, stats_show, NULL);
+
+static const struct attribute *simtemp_attrs[] = {
+    &sampling_ms_attr.attr,
+    &sampling_ns_attr.attr,
+    &running_attr.attr,
+    &threshold_mC_attr.attr,
+    &threshold_low_mC_attr.attr,
+    &mode_attr.attr,
+    &seed_attr.attr,
+    &waveform_attr.attr,
+    &replay_speed_attr.attr,
+    &gen_context_attr.attr,
+    &cpu_attr.attr,
+    &batch_attr.attr,
+    &wakeup_watermark_attr.attr,
+    &wakeup_timeout_ns_attr.attr,
+    &agg_window_ns_attr.attr,
+    &buffer_size_attr.attr,
+    &stats_attr.attr,
+    NULL,
+};
+
+static struct bin_attribute lut_attr = {
+    .attr  = { .name = "lut", .mode = 0664 },
+    .size  = SIMTEMP_MAX_LUT * sizeof(s32),
+    .read  = lut_read,
+    .write = lut_write,
+};
+
+static struct bin_attribute stats_bin_attr = {
+    .attr  = { .name = "stats_bin", .mode = 0444 },
+    .size  = sizeof(struct simtemp_stats),
+    .read  = stats_bin_read,
+};
+
+/* ============================================================
+ *                 TEMPERATURE GENERATORS
+ * ============================================================
+ * One ops entry per enum simtemp_mode. The producer calls
+ * dev->gen->fill() for up to SIMTEMP_GEN_CHUNK values at a time,
+ * without locks or string compares; a mode change just publishes
+ * another table entry.
+ *
+ * The noise generators draw from a per-instance prandom state rather
+ * than get_random_u32(): a simulator needs speed and reproducible
+ * runs (seed attribute), not cryptographic randomness.
+ * ============================================================ */
+
+/* n uniform values in mean ± delta. reciprocal_scale() maps a u32 to
+ * [0, 2 * delta) with a multiply instead of a division. */
+static void simtemp_fill_uniform(struct nxp_simtemp_dev *dev, s32 *temp_mC,
+                                 unsigned int n, s32 mean, s32 delta)
+{
+    u32 *r = (u32 *)temp_mC;
+    unsigned int i;
+
+    prandom_bytes_state(&dev->rnd, r, n * sizeof(*r));
+    for (i = 0; i < n; i++)
+        temp_mC[i] = mean + (s32)reciprocal_scale(r[i], 2 * delta) - delta;
+}
+
+static void simtemp_gen_normal(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    simtemp_fill_uniform(dev, temp_mC, n, NORMAL_MEAN_MILLIC, NORMAL_DELTA_MILLIC);
+}
+
+static void simtemp_gen_noisy(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    simtemp_fill_uniform(dev, temp_mC, n, NOISY_MEAN_MILLIC, NOISY_DELTA_MILLIC);
+}
+
+static void simtemp_gen_ramp(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        dev->ramp_mC += RAMP_STEP_MILLIC;
+        if (dev->ramp_mC > RAMP_MAX_MILLIC)
+            dev->ramp_mC = RAMP_START_MILLIC;
+        temp_mC[i] = dev->ramp_mC;
+    }
+}
+
+/* Gaussian value with standard deviation sigma (Irwin-Hall: the sum of
+ * twelve 16-bit uniforms has mean 12 * 32767.5 and sigma 65536) */
+static s32 simtemp_gauss(struct nxp_simtemp_dev *dev, s32 sigma)
+{
+    s64 sum = 0;
+    u32 r;
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        r = prandom_u32_state(&dev->rnd);
+        sum += (r & 0xffff) + (r >> 16);
+    }
+    return (s32)(((sum - 393210) * sigma) >> 16);
+}
+
+/* Advances the waveform position; true when a new period started */
+static inline bool simtemp_wave_step(struct nxp_simtemp_dev *dev, u32 period)
+{
+    if (++dev->wave_pos >= period) {
+        dev->wave_pos = 0;
+        return true;
+    }
+    return false;
+}
+
+static inline s32 simtemp_wave_noise(struct nxp_simtemp_dev *dev, s32 sigma)
+{
+    return sigma ? simtemp_gauss(dev, sigma) : 0;
+}
+
+static void simtemp_gen_sine(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    struct simtemp_wave_cfg *w = &dev->wave;
+    unsigned int i;
+    s32 sin;
+
+    for (i = 0; i < n; i++) {
+        sin = fixp_sin32_rad(dev->wave_pos, w->period);  /* Q31 */
+        temp_mC[i] = w->base_mC + (s32)(((s64)w->amplitude_mC * sin) >> 31) +
+                     simtemp_wave_noise(dev, w->noise_mC);
+        simtemp_wave_step(dev, w->period);
+    }
+}
+
+/* Square wave: low for the first half of the period, high for the second */
+static inline s32 simtemp_wave_square(struct nxp_simtemp_dev *dev)
+{
+    struct simtemp_wave_cfg *w = &dev->wave;
+
+    return dev->wave_pos < w->period / 2 ? w->base_mC : w->base_mC + w->amplitude_mC;
+}
+
+static void simtemp_gen_step(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        temp_mC[i] = simtemp_wave_square(dev) + simtemp_wave_noise(dev, dev->wave.noise_mC);
+        simtemp_wave_step(dev, dev->wave.period);
+    }
+}
+
+/* First-order thermal RC model driven by the step wave (heater on/off):
+ * T += (target - T) / tau per sample. The state is kept in micro-degrees
+ * so slow responses do not stall on integer truncation. */
+static void simtemp_gen_rc(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    struct simtemp_wave_cfg *w = &dev->wave;
+    s64 target;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        target = (s64)simtemp_wave_square(dev) * 1000;
+        dev->rc_uC += div_s64(target - dev->rc_uC, w->tau);
+        temp_mC[i] = (s32)div_s64(dev->rc_uC, 1000) + simtemp_wave_noise(dev, w->noise_mC);
+        simtemp_wave_step(dev, w->period);
+    }
+}
+
+static void simtemp_gen_gaussian(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        temp_mC[i] = dev->wave.base_mC + simtemp_wave_noise(dev, dev->wave.noise_mC);
+}
+
+/* Without a table the lut mode holds base_mC */
+static void simtemp_gen_lut(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n)
+{
+    const s32 *lut = dev->lut;
+    u32 len = dev->lut_len;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        if (!lut || !len) {
+            temp_mC[i] = dev->wave.base_mC;
+            continue;
+        }
+        if (dev->wave_pos >= len)
+            dev->wave_pos = 0;
+        temp_mC[i] = lut[dev->wave_pos] + simtemp_wave_noise(dev, dev->wave.noise_mC);
+        dev->wave_pos++;
+    }
+}
+
+static const struct simtemp_gen_ops simtemp_gens[SIMTEMP_MODE_COUNT] = {
+    [SIMTEMP_MODE_NORMAL]   = { .fill = simtemp_gen_normal },
+    [SIMTEMP_MODE_NOISY]    = { .fill = simtemp_gen_noisy },
+    [SIMTEMP_MODE_RAMP]     = { .fill = simtemp_gen_ramp },
+    [SIMTEMP_MODE_SINE]     = { .fill = simtemp_gen_sine },
+    [SIMTEMP_MODE_STEP]     = { .fill = simtemp_gen_step },
+    [SIMTEMP_MODE_RC]       = { .fill = simtemp_gen_rc },
+    [SIMTEMP_MODE_GAUSSIAN] = { .fill = simtemp_gen_gaussian },
+    [SIMTEMP_MODE_LUT]      = { .fill = simtemp_gen_lut },
+    [SIMTEMP_MODE_REPLAY]   = { .emit = simtemp_replay },
+};
+
+static_assert(ARRAY_SIZE(simtemp_mode_names) == SIMTEMP_MODE_COUNT);
+
+/* Switching to SIMTEMP_MODE_REPLAY starts a fresh pass of the trace, so
+ * records are not all due at once after time spent in another mode; the
+ * producer must be stopped then */
+static void simtemp_set_mode(struct nxp_simtemp_dev *dev, enum simtemp_mode mode)
+{
+    if (mode == SIMTEMP_MODE_REPLAY)
+        dev->replay_pos = 0;
+    WRITE_ONCE(dev->mode, mode);
+    WRITE_ONCE(dev->gen, &simtemp_gens[mode]);
+}
+
+/* Reset all generator state; the producer must be stopped */
+static void simtemp_seed(struct nxp_simtemp_dev *dev, u64 seed)
+{
+    WRITE_ONCE(dev->seed, seed);
+    prandom_seed_state(&dev->rnd, seed);
+    dev->ramp_mC = RAMP_START_MILLIC;
+    dev->wave_pos = 0;
+    dev->rc_uC = (s64)dev->wave.base_mC * 1000;
+}
+
+/* Flag bits of a newly generated sample with temperature temp_mC */
+static inline u32 simtemp_sample_flags(struct nxp_simtemp_dev *dev, s32 temp_mC)
+{
+    u32 flags = SIMTEMP_FLAG_NEW;
+
+    if (temp_mC > READ_ONCE(dev->threshold_mC))
+        flags |= SIMTEMP_FLAG_ALERT;
+    if (unlikely(dev->restarted)) {
+        flags |= SIMTEMP_FLAG_RESTART;
+        dev->restarted = false;
+    }
+    return flags;
+}
+
+/* Builds one sample with temperature temp_mC at ts */
+static void simtemp_make_sample(struct nxp_simtemp_dev *dev, s32 temp_mC, ktime_t ts,
+                                struct simtemp_sample *s)
+{
+    s->timestamp_ns = ktime_to_ns(ts);
+    s->seq = dev->seq++;
+    s->temp_mC = temp_mC;
+    s->flags = simtemp_sample_flags(dev, temp_mC);
+}
+
+/* ============================================================
+ *                 LATENCY HISTOGRAMS (debugfs)
+ * ============================================================
+ * <debugfs>/nxp_simtemp/<name>/ holds one log2 histogram per stage
+ * of a sample's path to user space:
+ *   - timer_jitter:    timer callback run time - programmed expiry
+ *   - publish_latency: timer expiry -> batch published to the ring
+ *   - read_latency:    batch published -> copied to user by read()
+ * Reading a file prints the non-empty range, writing to it clears it.
+ * ============================================================ */
+
+static struct dentry *simtemp_debugfs_root;
+
+static inline void simtemp_hist_add(struct simtemp_hist *h, s64 ns)
+{
+    unsigned int b = ns > 1 ? min_t(unsigned int, ilog2((u64)ns), SIMTEMP_HIST_BUCKETS - 1) : 0;
+
+    atomic64_inc(&h->bucket[b]);
+}
+
+static int simtemp_hist_show(struct seq_file *m, void *v)
+{
+    struct simtemp_hist *h = m->private;
+    int b, last = -1;
+
+    for (b = 0; b < SIMTEMP_HIST_BUCKETS; b++)
+        if (atomic64_read(&h->bucket[b]))
+            last = b;
+
+    seq_printf(m, "%12s %12s %14s\n", "from_ns", "to_ns", "count");
+    for (b = 0; b <= last; b++) {
+        u64 lo = b ? 1ULL << b : 0;
+
+        if (b == SIMTEMP_HIST_BUCKETS - 1)
+            seq_printf(m, "%12llu %12s", lo, "inf");
+        else
+            seq_printf(m, "%12llu %12llu", lo, 1ULL << (b + 1));
+        seq_printf(m, " %14lld\n", atomic64_read(&h->bucket[b]));
+    }
+    return 0;
+}
+
+static int simtemp_hist_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, simtemp_hist_show, inode->i_private);
+}
+
+static ssize_t simtemp_hist_write(struct file *file, const char __user *buf,
+                                  size_t count, loff_t *ppos)
+{
+    struct simtemp_hist *h = ((struct seq_file *)file->private_data)->private;
+    int b;
+
+    for (b = 0; b < SIMTEMP_HIST_BUCKETS; b++)
+        atomic64_set(&h->bucket[b], 0);
+    return count;
+}
+
+static const struct file_operations simtemp_hist_fops = {
+    .owner   = THIS_MODULE,
+    .open    = simtemp_hist_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .write   = simtemp_hist_write,
+    .release = single_release,
+};
+
+static void simtemp_debugfs_add(struct nxp_simtemp_dev *dev)
+{
+    dev->debugfs = debugfs_create_dir(dev->name, simtemp_debugfs_root);
+    debugfs_create_file("timer_jitter", 0644, dev->debugfs, &dev->jitter_hist,
+                        &simtemp_hist_fops);
+    debugfs_create_file("publish_latency", 0644, dev->debugfs, &dev->publish_hist,
+                        &simtemp_hist_fops);
+    debugfs_create_file("read_latency", 0644, dev->debugfs, &dev->read_hist,
+                        &simtemp_hist_fops);
+}
+
+/* Record how long ago the newest sample a read() returned was published.
+ * Only reads that end at the last published batch are counted: for
+ * older samples the publication time is no longer known. */
+static void simtemp_note_read_latency(struct nxp_simtemp_dev *dev, u32 end)
+{
+    ktime_t pub_time;
+    unsigned int seq;
+    u32 pub_head;
+
+    do {
+        seq = read_seqcount_begin(&dev->pub_seq);
+        pub_head = dev->pub_head;
+        pub_time = dev->pub_time;
+    } while (read_seqcount_retry(&dev->pub_seq, seq));
+
+    if (pub_head == end)
+        simtemp_hist_add(&dev->read_hist, ktime_to_ns(ktime_sub(ktime_get(), pub_time)));
+}
+
+/* ============================================================
+ *                 SAMPLE GENERATION WORK FUNCTION
+ * ============================================================ */
+
+/* The ring is single-producer and lock-free. head and tail are
+ * free-running counters and the slot index is derived from them, so an
+ * overrun can be detected by comparing counters after wrapping.
+ *
+ * The producer writes slot(head), then publishes head + 1 with a release
+ * store; an smp_wmb() keeps the next slot write from becoming visible
+ * before that publication. A reader therefore only has to consider one
+ * in-flight write, to slot(head), which clobbers counter head - buf_size:
+ * data read from [start, ...) is intact iff head - start < buf_size when
+ * head is re-read after the copy.
+ *
+ * Each reader owns its tail. It may live in a page mapped by the
+ * consumer, so it is always read with READ_ONCE() and clamped. */
+static inline u32 buf_head(struct nxp_simtemp_dev *dev)
+{
+    return smp_load_acquire(&dev->head);
+}
+
+/* Oldest counter still safe to read for a reader positioned at tail */
+static inline u32 buf_clamp(struct nxp_simtemp_dev *dev, u32 head, u32 tail)
+{
+    if (head - tail >= dev->buf_size)
+        tail = head - dev->buf_size + 1;
+    return tail;
+}
+
+static inline u32 reader_tail(struct simtemp_reader *r)
+{
+    return READ_ONCE(*READ_ONCE(r->tailp));
+}
+
+static inline bool reader_empty(struct simtemp_reader *r)
+{
+    return buf_head(r->dev) == reader_tail(r);
+}
+
+/* Blocking reads and poll() only report data once the producer released
+ * it with a wakeup (see simtemp_wake_readers()). The reader may already
+ * be past wake_head after a non-blocking read, hence the signed compare. */
+static inline bool reader_ready(struct simtemp_reader *r)
+{
+    return (s32)(smp_load_acquire(&r->dev->wake_head) - reader_tail(r)) > 0;
+}
+
+/* POLLPRI / SIMTEMP_IOC_GET_EVENT: an alert edge this file has not seen */
+static inline bool reader_has_event(struct simtemp_reader *r)
+{
+    return smp_load_acquire(&r->dev->ev_head) != READ_ONCE(r->ev_tail);
+}
+
+/* Aggregated stream: a closed window this file has not read */
+static inline bool reader_has_agg(struct simtemp_reader *r)
+{
+    return smp_load_acquire(&r->dev->agg_head) != READ_ONCE(r->agg_tail);
+}
+
+/* Track the ring occupancy high-water mark as seen by readers */
+static void simtemp_note_occupancy(struct nxp_simtemp_dev *dev, u32 head, u32 tail)
+{
+    int occ = min(head - tail, dev->buf_size);
+    int old = atomic_read(&dev->stats.high_water);
+
+    while (occ > old && !atomic_try_cmpxchg(&dev->stats.high_water, &old, occ))
+        ;
+}
+
+static inline unsigned int buf_slot(struct nxp_simtemp_dev *dev, u32 pos)
+{
+    return pos & dev->buf_mask;
+}
+
+/* Wake blocking readers once wakeup_watermark samples are pending, the
+ * oldest pending one is wakeup_timeout old, or an alert event or
+ * aggregated window was queued. This runs once per batch, so the
+ * timeout is checked at the expiries and a reader waits at most
+ * wakeup_timeout plus one batch interval; simtemp_producer_stop()
+ * releases whatever is still pending.
+ * Like perf's wakeup_events, this trades latency for fewer context
+ * switches; the defaults (1, off) wake on every batch. */
+static void simtemp_wake_readers(struct nxp_simtemp_dev *dev, u32 head, ktime_t ts)
+{
+    unsigned int wm = min(READ_ONCE(dev->wakeup_watermark), dev->buf_size);
+    ktime_t timeout = READ_ONCE(dev->wakeup_timeout);
+    u32 pending = head - dev->wake_head;
+
+    /* Below the watermark (<= buf_size) the oldest pending sample, the
+     * one at wake_head, has not been overwritten yet */
+    if (dev->ev_head == dev->wake_ev_head && dev->agg_head == dev->wake_agg_head &&
+        pending < wm &&
+        !(timeout && pending &&
+          ktime_sub(ts, ns_to_ktime(dev->buffer[buf_slot(dev, dev->wake_head)].timestamp_ns)) >= timeout))
+        return;
+
+    smp_store_release(&dev->wake_head, head);
+    dev->wake_ev_head = dev->ev_head;
+    dev->wake_agg_head = dev->agg_head;
+    wake_up_interruptible(&dev->wq);
+    atomic64_inc(&dev->stats.wakeups);
+}
+
+/* Fold a sample into the current aggregation window. A sample outside
+ * the window closes it first: the window is queued (same broadcast
+ * protocol as the events) and a new one starts at this sample. */
+static void simtemp_agg_update(struct nxp_simtemp_dev *dev, const struct simtemp_sample *s)
+{
+    struct simtemp_agg *cur = &dev->agg_cur;
+
+    if (cur->count && s->timestamp_ns - cur->start_ns >= ktime_to_ns(READ_ONCE(dev->agg_window))) {
+        cur->mean_mC = (s32)div_s64(dev->agg_sum, cur->count);
+        smp_wmb();  /* order the previous agg_head publication before this slot write */
+        dev->aggs[dev->agg_head & (SIMTEMP_AGG_RING - 1)] = *cur;
+        smp_store_release(&dev->agg_head, dev->agg_head + 1);
+        cur->seq++;
+        cur->count = 0;
+    }
+
+    if (!cur->count) {
+        cur->start_ns = s->timestamp_ns;
+        cur->min_mC = s->temp_mC;
+        cur->max_mC = s->temp_mC;
+        dev->agg_sum = 0;
+    }
+    cur->end_ns = s->timestamp_ns;
+    cur->min_mC = min(cur->min_mC, s->temp_mC);
+    cur->max_mC = max(cur->max_mC, s->temp_mC);
+    dev->agg_sum += s->temp_mC;
+    cur->count++;
+}
+
+/* Alert state machine with hysteresis: queue an event on every edge.
+ * The event queue is a broadcast ring like the sample ring (single
+ * producer, one cursor per file, release-published head). */
+static void simtemp_alert_update(struct nxp_simtemp_dev *dev, const struct simtemp_sample *s)
 {
-    return sprintf(buf, "%d\n", gdev->threshold_mC);
+    s32 high = READ_ONCE(dev->threshold_mC);
+    s32 low = min(READ_ONCE(dev->threshold_low_mC), high);
+    struct simtemp_event *ev;
+    u32 type;
+
+    if (!dev->alert_active && s->temp_mC > high)
+        type = SIMTEMP_EVENT_RISING;
+    else if (dev->alert_active && s->temp_mC < low)
+        type = SIMTEMP_EVENT_FALLING;
+    else
+        return;
+    dev->alert_active = type == SIMTEMP_EVENT_RISING;
+
+    smp_wmb();  /* order the previous ev_head publication before this slot write */
+    ev = &dev->events[dev->ev_head & (SIMTEMP_EVENT_RING - 1)];
+    ev->timestamp_ns = s->timestamp_ns;
+    ev->temp_mC = s->temp_mC;
+    ev->type = type;
+    ev->seq = s->seq;
+    ev->lost = 0;
+    ev->reserved = 0;
+    smp_store_release(&dev->ev_head, dev->ev_head + 1);
 }
 
-static ssize_t threshold_mC_store(struct kobject *kobj, struct kobj_attribute *attr,
-                                  const char *buf, size_t count)
+/* Store one sample in the circular buffer (single producer, no lock).
+ * head is published after every sample, which keeps the reader's
+ * one-in-flight-slot lap check valid. Returns true for an alert. */
+static inline bool simtemp_push(struct nxp_simtemp_dev *dev, const struct simtemp_sample *s,
+                                u32 *head)
 {
-    s32 val;
-    if (kstrtos32(buf, 10, &val))
-        return -EINVAL;
-    gdev->threshold_mC = val;
-    return count;
+    smp_wmb();  /* order the previous head publication before this slot write */
+    dev->buffer[buf_slot(dev, *head)] = *s;
+    (*head)++;
+    smp_store_release(&dev->head, *head);
+    smp_store_release(&dev->ring->head, *head);
+
+    trace_simtemp_sample(dev->misc.minor, s, *head);
+    simtemp_alert_update(dev, s);
+    simtemp_agg_update(dev, s);
+    if (!(s->flags & SIMTEMP_FLAG_ALERT))
+        return false;
+    trace_simtemp_alert(dev->misc.minor, s, READ_ONCE(dev->threshold_mC));
+    return true;
 }
 
-static ssize_t mode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+/* Producer latency of a batch: from its timer expiry ts to the samples
+ * being published at now. Only the producer writes the min/max, so a
+ * plain read-compare-set is enough. */
+static void simtemp_note_latency(struct nxp_simtemp_dev *dev, ktime_t ts, ktime_t now)
 {
-    return sprintf(buf, "%s\n", gdev->mode);
+    s64 lat = max_t(s64, ktime_to_ns(ktime_sub(now, ts)), 0);
+    s64 min = atomic64_read(&dev->stats.lat_min_ns);
+
+    if (!atomic64_read(&dev->stats.updates) || lat < min)
+        atomic64_set(&dev->stats.lat_min_ns, lat);
+    if (lat > atomic64_read(&dev->stats.lat_max_ns))
+        atomic64_set(&dev->stats.lat_max_ns, lat);
+    simtemp_hist_add(&dev->publish_hist, lat);
 }
 
-static ssize_t mode_store(struct kobject *kobj, struct kobj_attribute *attr,
-                          const char *buf, size_t count)
+/* Account n pushed samples and wake readers, once per expiry. The
+ * producer is the only writer of pub_seq, so it needs no lock. */
+static void simtemp_push_done(struct nxp_simtemp_dev *dev, u32 head, ktime_t ts,
+                              unsigned int n, unsigned int alerts)
 {
-    char tmp[16];
-    strncpy(tmp, buf, sizeof(tmp) - 1);
-    tmp[sizeof(tmp) - 1] = '\0';
+    ktime_t now = ktime_get();
 
-    /* Accept only valid mode strings */
-    if (strncmp(tmp, "normal", 16) != 0 &&
-        strncmp(tmp, "noisy", 16) != 0 &&
-        strncmp(tmp, "ramp", 16) != 0)
-        return -EINVAL;
+    raw_write_seqcount_begin(&dev->pub_seq);
+    dev->pub_head = head;
+    dev->pub_time = now;
+    raw_write_seqcount_end(&dev->pub_seq);
 
-    strncpy(gdev->mode, tmp, sizeof(gdev->mode));
-    return count;
+    simtemp_note_latency(dev, ts, now);
+    atomic64_add(n, &dev->stats.updates);
+    if (alerts)
+        atomic64_add(alerts, &dev->stats.alerts);
+
+    simtemp_wake_readers(dev, head, ts);
 }
 
-/* Read-only system statistics: updates, alerts, and errors */
-static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+/* Generates the batch of samples due at timer expiry ts and pushes them
+ * to the ring. Sample i of n is stamped ts - (n - 1 - i) * period, so a
+ * batch back-fills the interval since the previous expiry and timestamps
+ * do not carry the latency of the context running this. Readers are
+ * woken at most once per batch. */
+static void simtemp_generate(struct nxp_simtemp_dev *dev, ktime_t ts)
 {
-    return sprintf(buf, "updates=%u alerts=%u last_error=%u\n",
-                   gdev->stats.updates,
-                   gdev->stats.alerts,
-                   gdev->stats.last_error);
-}
+    const struct simtemp_gen_ops *gen = READ_ONCE(dev->gen);
+    unsigned int n = READ_ONCE(dev->batch);
+    ktime_t period = READ_ONCE(dev->period);
+    s32 temp_mC[SIMTEMP_GEN_CHUNK];
+    struct simtemp_sample s;
+    unsigned int i, alerts = 0;
+    u32 head = dev->head;
 
-/* Sysfs attributes registration */
-static struct kobj_attribute sampling_ms_attr = __ATTR(sampling_ms, 0664, sampling_ms_show, sampling_ms_store);
-static struct kobj_attribute threshold_mC_attr = __ATTR(threshold_mC, 0664, threshold_mC_show, threshold_mC_store);
-static struct kobj_attribute mode_attr = __ATTR(mode, 0664, mode_show, mode_store);
-static struct kobj_attribute stats_attr = __ATTR(stats, 0444, stats_show, NULL);
+    if (gen->emit) {
+        gen->emit(dev, ts);
+        return;
+    }
 
-/* ============================================================
- *                 SAMPLE GENERATION WORK FUNCTION
- * ============================================================ */
+    for (i = 0; i < n; i++) {
+        if (i % SIMTEMP_GEN_CHUNK == 0)
+            gen->fill(dev, temp_mC, min_t(unsigned int, n - i, SIMTEMP_GEN_CHUNK));
+        simtemp_make_sample(dev, temp_mC[i % SIMTEMP_GEN_CHUNK],
+                            ktime_sub(ts, ktime_mul_ns(period, n - 1 - i)), &s);
+        alerts += simtemp_push(dev, &s, &head);
+    }
+
+    simtemp_push_done(dev, head, ts, n, alerts);
+}
 
-static inline bool buf_empty(struct nxp_simtemp_dev *dev)
+/* Replays the loaded trace: every record whose recorded offset from the
+ * first record, divided by replay_speed, has elapsed since the pass
+ * started is pushed, stamped with that due time. Records are copied
+ * straight from the preloaded buffer into the ring. Delivery is at timer
+ * granularity (sampling_ns); the timestamps keep the recorded spacing.
+ * Flags are recomputed against the current threshold. The trace loops.
+ * At most SIMTEMP_MAX_BATCH records (and no more than the ring holds)
+ * are pushed per expiry; a larger backlog drains over the following ones. */
+static void simtemp_replay(struct nxp_simtemp_dev *dev, ktime_t ts)
 {
-    return dev->head == dev->tail;
+    const struct simtemp_sample *rec = dev->replay;
+    u32 speed = READ_ONCE(dev->replay_speed);
+    unsigned int max = speed ? min_t(unsigned int, dev->buf_size, SIMTEMP_MAX_BATCH) :
+                               READ_ONCE(dev->batch);
+    unsigned int n = 0, alerts = 0;
+    struct simtemp_sample s;
+    u32 head = dev->head;
+    u64 delta;
+
+    if (!dev->replay_len)
+        return;
+    if (dev->replay_pos == 0)
+        dev->replay_t0 = ts;
+
+    while (n < max && dev->replay_pos < dev->replay_len) {
+        const struct simtemp_sample *r = &rec[dev->replay_pos];
+
+        s = *r;
+        if (speed) {
+            delta = r->timestamp_ns > rec[0].timestamp_ns ?
+                    r->timestamp_ns - rec[0].timestamp_ns : 0;
+            s.timestamp_ns = ktime_to_ns(dev->replay_t0) + div_u64(delta, speed);
+            if (s.timestamp_ns > ktime_to_ns(ts))
+                break;
+        } else {
+            s.timestamp_ns = ktime_to_ns(ts);
+        }
+        s.seq = dev->seq++;
+        s.flags = simtemp_sample_flags(dev, s.temp_mC);
+
+        alerts += simtemp_push(dev, &s, &head);
+        dev->replay_pos++;
+        n++;
+    }
+    if (dev->replay_pos == dev->replay_len)
+        dev->replay_pos = 0;
+
+    if (n)
+        simtemp_push_done(dev, head, ts, n, alerts);
 }
 
-/* Called periodically by the hrtimer callback (via workqueue).
- * Simulates a new temperature sample based on current mode. */
+/* Workqueue half of SIMTEMP_CTX_WORKQUEUE / SIMTEMP_CTX_HIGHPRI */
 static void simtemp_work_func(struct work_struct *work)
 {
     struct nxp_simtemp_dev *dev = container_of(work, struct nxp_simtemp_dev, work);
-    struct simtemp_sample s;
-    unsigned long flags;
-    ktime_t now = ktime_get();
 
-    s.timestamp_ns = ktime_to_ns(now);
+    simtemp_generate(dev, READ_ONCE(dev->work_expiry));
+}
+
+/* ============================================================
+ *                 HIGH-RESOLUTION TIMER CALLBACK
+ * ============================================================
+ * Generates the sample in place (SIMTEMP_CTX_HRTIMER) or hands
+ * the expiry time to the work item, queued on the timer's CPU when
+ * the instance is pinned. Expiries skipped because the
+ * callback ran late and ticks merged into a still pending work
+ * item are accounted in stats.
+ * ============================================================ */
+/* Timer interval: one expiry per batch of samples */
+static inline ktime_t simtemp_interval(struct nxp_simtemp_dev *dev)
+{
+    ktime_t period = READ_ONCE(dev->period);
+    unsigned int batch = READ_ONCE(dev->batch);
+
+    if (period > div_s64(KTIME_MAX, batch))
+        return KTIME_MAX;
+    return period * batch;
+}
+
+static enum hrtimer_restart simtemp_timer_cb(struct hrtimer *t)
+{
+    struct nxp_simtemp_dev *dev = container_of(t, struct nxp_simtemp_dev, timer);
+    ktime_t expiry = hrtimer_get_expires(t);
+    bool queued = true;
+    u64 overruns;
 
-    /* Generate simulated temperature according to selected mode */
-    if (strcmp(dev->mode, "ramp") == 0) {
-        static int ramp = RAMP_START_MILLIC;
-        ramp += RAMP_STEP_MILLIC;
-        if (ramp > RAMP_MAX_MILLIC)
-            ramp = RAMP_START_MILLIC;
-        s.temp_mC = ramp;
+    if (!dev->running)
+        return HRTIMER_NORESTART;
 
-    } else if (strcmp(dev->mode, "noisy") == 0) {
-        s.temp_mC = NOISY_MEAN_MILLIC + (get_random_u32() % (2 * NOISY_DELTA_MILLIC)) - NOISY_DELTA_MILLIC;
+    simtemp_hist_add(&dev->jitter_hist,
+                     max_t(s64, ktime_to_ns(ktime_sub(ktime_get(), expiry)), 0));
+
+    switch (dev->ctx) {
+    case SIMTEMP_CTX_HRTIMER:
+        simtemp_generate(dev, expiry);
+        break;
+    case SIMTEMP_CTX_HIGHPRI:
+        WRITE_ONCE(dev->work_expiry, expiry);
+        queued = dev->cpu >= 0 ? queue_work_on(dev->cpu, system_highpri_wq, &dev->work) :
+                                 queue_work(dev->gen_wq, &dev->work);
+        break;
+    default:
+        WRITE_ONCE(dev->work_expiry, expiry);
+        queued = dev->cpu >= 0 ? schedule_work_on(dev->cpu, &dev->work) :
+                                 schedule_work(&dev->work);
+        break;
+    }
+    if (!queued)
+        atomic64_inc(&dev->stats.coalesced);
 
-    } else { /* Normal mode */
-        s.temp_mC = NORMAL_MEAN_MILLIC + (get_random_u32() % (2 * NORMAL_DELTA_MILLIC)) - NORMAL_DELTA_MILLIC;
+    overruns = hrtimer_forward_now(&dev->timer, simtemp_interval(dev));
+    if (overruns > 1) {
+        atomic64_add(overruns - 1, &dev->stats.overruns);
+        atomic64_add((overruns - 1) * READ_ONCE(dev->batch), &dev->stats.missed);
     }
+    return HRTIMER_RESTART;
+}
 
-    /* Set flag bits */
-    s.flags = 1;
-    if (s.temp_mC > dev->threshold_mC)
-        s.flags |= 2;
+/* In-callback generation runs the timer in softirq context so the
+ * generator and wakeup stay out of hardirq, also on PREEMPT_RT; the
+ * workqueue contexts only queue work and keep a hard timer. A pinned
+ * timer stays on the CPU it was started on. */
+static inline enum hrtimer_mode simtemp_timer_mode(struct nxp_simtemp_dev *dev)
+{
+    enum hrtimer_mode mode = dev->ctx == SIMTEMP_CTX_HRTIMER ?
+                             HRTIMER_MODE_REL_SOFT : HRTIMER_MODE_REL;
 
-    /* Store sample in circular buffer (protected by spinlock) */
-    spin_lock_irqsave(&dev->lock, flags);
-    dev->buffer[dev->head] = s;
-    dev->head = (dev->head + 1) % dev->buf_size;
-    if (dev->head == dev->tail)
-        dev->tail = (dev->tail + 1) % dev->buf_size;
+    if (dev->cpu >= 0)
+        mode |= HRTIMER_MODE_PINNED;
+    return mode;
+}
 
-    dev->stats.updates++;
-    if (s.flags & 2)
-        dev->stats.alerts++;
-    spin_unlock_irqrestore(&dev->lock, flags);
+static void simtemp_timer_arm(void *data)
+{
+    struct nxp_simtemp_dev *dev = data;
 
-    /* Wake up any blocking readers */
-    wake_up_interruptible(&dev->wq);
+    hrtimer_start(&dev->timer, simtemp_interval(dev), simtemp_timer_mode(dev));
+}
+
+/* (Re)arm the sampling timer, on the pinned CPU if there is one. The
+ * producer is stopped, so the next sample it generates is flagged. */
+static void simtemp_timer_start(struct nxp_simtemp_dev *dev)
+{
+    dev->restarted = true;
+    hrtimer_init(&dev->timer, CLOCK_MONOTONIC, simtemp_timer_mode(dev));
+    dev->timer.function = simtemp_timer_cb;
+
+    if (dev->cpu >= 0 && !smp_call_function_single(dev->cpu, simtemp_timer_arm, dev, 1))
+        return;
+    if (dev->cpu >= 0)
+        dev_warn(&dev->pdev->dev, "CPU %d is offline, timer started on CPU %d\n",
+                 dev->cpu, raw_smp_processor_id());
+    simtemp_timer_arm(dev);
+}
 
-    pr_info(DRIVER_NAME ": new sample = %d m°C flags=0x%x (head=%u, tail=%u)\n",
-            s.temp_mC, s.flags, dev->head, dev->tail);
+/* Stop producing: after this neither the timer nor the work item runs.
+ * Samples the watermark was still holding back are released, since no
+ * further batch would wake the readers waiting for them. */
+static void simtemp_producer_stop(struct nxp_simtemp_dev *dev)
+{
+    hrtimer_cancel(&dev->timer);
+    cancel_work_sync(&dev->work);
+
+    if (dev->wake_head != dev->head) {
+        smp_store_release(&dev->wake_head, dev->head);
+        wake_up_interruptible(&dev->wq);
+    }
 }
 
 /* ============================================================
- *                 HIGH-RESOLUTION TIMER CALLBACK
+ *                 CPU HOTPLUG
  * ============================================================
- * Triggers the sample generation work periodically.
+ * A pinned instance is unpinned (cpu reads -1) while its CPU is
+ * going down, before the timer and work would be migrated or queued
+ * on a dead CPU, and pinned again when that CPU comes back unless the
+ * cpu setting was changed in the meantime. Both callbacks run in the
+ * hotplug thread and may sleep.
  * ============================================================ */
-static enum hrtimer_restart simtemp_timer_cb(struct hrtimer *t)
+
+static enum cpuhp_state simtemp_cpuhp_state;
+
+static void simtemp_repin(struct nxp_simtemp_dev *dev, int cpu)
 {
-    struct nxp_simtemp_dev *dev = container_of(t, struct nxp_simtemp_dev, timer);
+    simtemp_producer_stop(dev);
+    WRITE_ONCE(dev->cpu, cpu);
+    if (dev->running)
+        simtemp_timer_start(dev);
+}
 
-    if (!dev->running)
-        return HRTIMER_NORESTART;
+static int simtemp_cpu_online(unsigned int cpu, struct hlist_node *node)
+{
+    struct nxp_simtemp_dev *dev = hlist_entry(node, struct nxp_simtemp_dev, cpuhp_node);
 
-    schedule_work(&dev->work);
-    hrtimer_forward_now(&dev->timer, ms_to_ktime(dev->sampling_ms));
-    return HRTIMER_RESTART;
+    mutex_lock(&dev->cfg_lock);
+    if (dev->offline_cpu == cpu && dev->cpu == -1) {
+        dev->offline_cpu = -1;
+        simtemp_repin(dev, cpu);
+        dev_info(&dev->pdev->dev, "CPU %u back online, producer pinned again\n", cpu);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    return 0;
+}
+
+static int simtemp_cpu_offline(unsigned int cpu, struct hlist_node *node)
+{
+    struct nxp_simtemp_dev *dev = hlist_entry(node, struct nxp_simtemp_dev, cpuhp_node);
+
+    mutex_lock(&dev->cfg_lock);
+    if (dev->cpu == cpu) {
+        dev->offline_cpu = cpu;
+        simtemp_repin(dev, -1);
+        dev_info(&dev->pdev->dev, "CPU %u going offline, producer unpinned\n", cpu);
+    }
+    mutex_unlock(&dev->cfg_lock);
+    return 0;
 }
 
 /* ============================================================
@@ -175,168 +1518,885 @@ static enum hrtimer_restart simtemp_timer_cb(struct hrtimer *t)
  * Exposes /dev/simtemp for user-space reads and polling.
  * ============================================================ */
 
+/* Every open file gets its own cursor, starting at the next sample.
+ * misc_open() leaves the miscdevice in private_data. */
 static int simtemp_open(struct inode *inode, struct file *filp)
 {
-    filp->private_data = gdev;
+    struct nxp_simtemp_dev *dev = container_of(filp->private_data,
+                                               struct nxp_simtemp_dev, misc);
+    struct simtemp_reader *r;
+
+    r = kzalloc(sizeof(*r), GFP_KERNEL);
+    if (!r)
+        return -ENOMEM;
+
+    r->dev = dev;
+    mutex_init(&r->lock);
+    r->abi = SIMTEMP_ABI_V1;
+    r->tailp = &r->tail;
+    filp->private_data = r;
+
+    /* cfg_lock orders this against a concurrent ring resize */
+    mutex_lock(&dev->cfg_lock);
+    atomic_inc(&dev->open_count);
+    r->tail = buf_head(dev);
+    r->ev_tail = smp_load_acquire(&dev->ev_head);
+    r->agg_tail = smp_load_acquire(&dev->agg_head);
+    mutex_unlock(&dev->cfg_lock);
     return 0;
 }
 
-static ssize_t simtemp_read(struct file *filp, char __user *buf, size_t count, loff_t *off)
+/* Hand a trace written to this file over to the device. The producer is
+ * stopped around the swap since it reads the replay buffer unlocked. */
+static void simtemp_replay_load(struct simtemp_reader *r)
+{
+    struct nxp_simtemp_dev *dev = r->dev;
+    struct simtemp_sample *old;
+
+    mutex_lock(&dev->cfg_lock);
+    simtemp_producer_stop(dev);
+    old = dev->replay;
+    dev->replay = r->stage;
+    dev->replay_len = r->stage_len;
+    dev->replay_pos = 0;
+    if (dev->running)
+        simtemp_timer_start(dev);
+    mutex_unlock(&dev->cfg_lock);
+
+    vfree(old);
+    dev_info(&dev->pdev->dev, "loaded %u records for replay\n", r->stage_len);
+    r->stage = NULL;
+}
+
+static int simtemp_release(struct inode *inode, struct file *filp)
+{
+    struct simtemp_reader *r = filp->private_data;
+
+    if (r->stage_len)
+        simtemp_replay_load(r);
+    atomic_dec(&r->dev->open_count);
+    vfree(r->stage);
+    vfree(r->cursor);
+    kfree(r);
+    return 0;
+}
+
+/* Copy n samples starting at counter pos to user space. The ring is
+ * contiguous except across the wrap point, so this takes at most two
+ * copy_to_user() calls. */
+static int simtemp_copy_span(struct nxp_simtemp_dev *dev, char __user *buf,
+                             u32 pos, unsigned int n)
+{
+    unsigned int idx = buf_slot(dev, pos);
+    unsigned int first = min(n, dev->buf_size - idx);
+
+    if (copy_to_user(buf, &dev->buffer[idx], first * sizeof(struct simtemp_sample)))
+        return -EFAULT;
+    if (n > first &&
+        copy_to_user(buf + first * sizeof(struct simtemp_sample), &dev->buffer[0],
+                     (n - first) * sizeof(struct simtemp_sample)))
+        return -EFAULT;
+    return 0;
+}
+
+/* Legacy readers get v1 records, converted through a small bounce buffer */
+#define SIMTEMP_V1_CHUNK 32
+
+static_assert(sizeof(struct simtemp_sample_v1) == 16);
+static_assert(sizeof(struct simtemp_sample) == 24);
+static_assert(offsetof(struct simtemp_sample, flags) ==
+              offsetof(struct simtemp_sample_v1, flags));
+static_assert(sizeof(struct simtemp_event) == 32);
+static_assert(sizeof(struct simtemp_agg) == 40);
+static_assert(sizeof(struct simtemp_config) == 88);
+static_assert(sizeof(struct simtemp_stats) == 120);
+
+static int simtemp_copy_v1(struct nxp_simtemp_dev *dev, char __user *buf,
+                           u32 pos, unsigned int n)
+{
+    struct simtemp_sample_v1 tmp[SIMTEMP_V1_CHUNK];
+    unsigned int i, k;
+
+    while (n) {
+        k = min_t(unsigned int, n, SIMTEMP_V1_CHUNK);
+        for (i = 0; i < k; i++) {
+            const struct simtemp_sample *s = &dev->buffer[buf_slot(dev, pos + i)];
+
+            tmp[i].timestamp_ns = s->timestamp_ns;
+            tmp[i].temp_mC = s->temp_mC;
+            tmp[i].flags = s->flags;
+        }
+        if (copy_to_user(buf, tmp, k * sizeof(tmp[0])))
+            return -EFAULT;
+        buf += k * sizeof(tmp[0]);
+        pos += k;
+        n -= k;
+    }
+    return 0;
+}
+
+static inline size_t reader_record_size(struct simtemp_reader *r)
+{
+    return r->abi == SIMTEMP_ABI_V2 ? sizeof(struct simtemp_sample) :
+                                      sizeof(struct simtemp_sample_v1);
+}
+
+/* Aggregated stream: returns as many whole windows as fit in the user
+ * buffer. Lost windows show up as a gap in seq. */
+static ssize_t simtemp_read_agg(struct file *filp, char __user *buf, size_t count)
 {
-    struct nxp_simtemp_dev *dev = filp->private_data;
+    struct simtemp_reader *r = filp->private_data;
+    struct nxp_simtemp_dev *dev = r->dev;
+    size_t max = count / sizeof(struct simtemp_agg);
+    unsigned int n, idx, first;
+    u32 head, start;
     ssize_t ret = 0;
-    unsigned long flags;
 
-    if (count < sizeof(struct simtemp_sample))
+    if (max == 0) {
+        mutex_unlock(&r->lock);
         return -EINVAL;
+    }
 
-    /* Wait for data if buffer is empty */
-    spin_lock_irqsave(&dev->lock, flags);
-    if (buf_empty(dev)) {
-        spin_unlock_irqrestore(&dev->lock, flags);
+    while (!reader_has_agg(r)) {
+        mutex_unlock(&r->lock);
         if (filp->f_flags & O_NONBLOCK)
             return -EAGAIN;
-        if (wait_event_interruptible(dev->wq, !buf_empty(dev)))
+        if (wait_event_interruptible(dev->wq, reader_has_agg(r)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&r->lock))
             return -ERESTARTSYS;
-        spin_lock_irqsave(&dev->lock, flags);
     }
 
-    /* Copy sample to user space */
-    if (copy_to_user(buf, &dev->buffer[dev->tail], sizeof(struct simtemp_sample)))
-        ret = -EFAULT;
-    else
-        ret = sizeof(struct simtemp_sample);
+    do {
+        head = smp_load_acquire(&dev->agg_head);
+        start = r->agg_tail;
+        if (head - start >= SIMTEMP_AGG_RING)
+            start = head - SIMTEMP_AGG_RING + 1;
+        n = min_t(size_t, head - start, max);
+        idx = start & (SIMTEMP_AGG_RING - 1);
+        first = min_t(unsigned int, n, SIMTEMP_AGG_RING - idx);
+
+        if (copy_to_user(buf, &dev->aggs[idx], first * sizeof(struct simtemp_agg)) ||
+            copy_to_user(buf + first * sizeof(struct simtemp_agg), &dev->aggs[0],
+                         (n - first) * sizeof(struct simtemp_agg))) {
+            WRITE_ONCE(dev->stats.last_error, EFAULT);
+            ret = -EFAULT;
+            break;
+        }
+        smp_rmb();
+    } while (READ_ONCE(dev->agg_head) - start >= SIMTEMP_AGG_RING);
+
+    if (!ret) {
+        r->agg_tail = start + n;
+        ret = n * sizeof(struct simtemp_agg);
+    }
+    mutex_unlock(&r->lock);
+    return ret;
+}
+
+/* Returns as many whole samples as fit in the user buffer. */
+static ssize_t simtemp_read(struct file *filp, char __user *buf, size_t count, loff_t *off)
+{
+    struct simtemp_reader *r = filp->private_data;
+    struct nxp_simtemp_dev *dev = r->dev;
+    size_t rec, max;
+    unsigned int n;
+    u32 head, tail, start, first_flags;
+    ssize_t ret;
+
+    if (mutex_lock_interruptible(&r->lock))
+        return -ERESTARTSYS;
+
+    if (r->stream == SIMTEMP_STREAM_AGG)
+        return simtemp_read_agg(filp, buf, count);
+
+    rec = reader_record_size(r);
+    max = count / rec;
+    if (max == 0) {
+        mutex_unlock(&r->lock);
+        return -EINVAL;
+    }
+
+    /* Non-blocking reads take whatever is there; blocking reads wait for
+     * the producer to release data (wakeup watermark) */
+    while ((filp->f_flags & O_NONBLOCK) ? reader_empty(r) : !reader_ready(r)) {
+        mutex_unlock(&r->lock);
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        if (wait_event_interruptible(dev->wq, reader_ready(r)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&r->lock))
+            return -ERESTARTSYS;
+    }
+
+    tail = reader_tail(r);
+    simtemp_note_occupancy(dev, buf_head(dev), tail);
+    do {
+        /* Snapshot the readable span and copy it; the producer keeps going */
+        head = buf_head(dev);
+        start = buf_clamp(dev, head, tail);
+        n = min_t(size_t, head - start, max);
+
+        if (r->abi == SIMTEMP_ABI_V2)
+            ret = simtemp_copy_span(dev, buf, start, n);
+        else
+            ret = simtemp_copy_v1(dev, buf, start, n);
+        if (ret) {
+            WRITE_ONCE(dev->stats.last_error, EFAULT);
+            break;
+        }
+        first_flags = READ_ONCE(dev->buffer[buf_slot(dev, start)].flags);
+
+        /* If the producer lapped us during the copy, part of what we copied
+         * was overwritten: retry from the new oldest sample. */
+        smp_rmb();
+        if (READ_ONCE(dev->head) - start >= dev->buf_size)
+            continue;
+
+        /* Mark the gap in-band on the first sample after it
+         * (flags sits at the same offset in every record layout) */
+        if (start != tail) {
+            struct simtemp_sample __user *first = (struct simtemp_sample __user *)buf;
+
+            first_flags |= SIMTEMP_FLAG_DROPPED;
+            if (copy_to_user(&first->flags, &first_flags, sizeof(first_flags))) {
+                WRITE_ONCE(dev->stats.last_error, EFAULT);
+                ret = -EFAULT;
+                break;
+            }
+            atomic64_add(start - tail, &dev->stats.dropped);
+        }
+
+        WRITE_ONCE(*r->tailp, start + n);
+        atomic64_add(n, &dev->stats.consumed);
+        simtemp_note_read_latency(dev, start + n);
+        ret = n * rec;
+        break;
+    } while (1);
+
+    mutex_unlock(&r->lock);
+    return ret;
+}
+
+/* Grow the staging buffer to hold at least n records (doubling) */
+static int simtemp_stage_reserve(struct simtemp_reader *r, u32 n)
+{
+    struct simtemp_sample *stage;
+    u32 cap;
+
+    if (n <= r->stage_cap)
+        return 0;
+    if (n > SIMTEMP_MAX_REPLAY)
+        return -ENOSPC;
+
+    cap = min_t(u32, max_t(u32, roundup_pow_of_two(n), 1024), SIMTEMP_MAX_REPLAY);
+    stage = vmalloc(array_size(cap, sizeof(*stage)));
+    if (!stage)
+        return -ENOMEM;
+    if (r->stage)
+        memcpy(stage, r->stage, r->stage_len * sizeof(*stage));
+    vfree(r->stage);
+    r->stage = stage;
+    r->stage_cap = cap;
+    return 0;
+}
 
-    /* Update tail pointer */
-    dev->tail = (dev->tail + 1) % dev->buf_size;
-    spin_unlock_irqrestore(&dev->lock, flags);
+/* Records written to the device (in the file's read() layout) form a
+ * trace for the replay mode; it replaces the loaded one when the file is
+ * closed, e.g. cat trace.bin > /dev/simtemp. */
+static ssize_t simtemp_write(struct file *filp, const char __user *buf, size_t count,
+                             loff_t *off)
+{
+    struct simtemp_reader *r = filp->private_data;
+    struct simtemp_sample_v1 v1;
+    size_t rec, n, i;
+    ssize_t ret;
+
+    if (mutex_lock_interruptible(&r->lock))
+        return -ERESTARTSYS;
+
+    rec = reader_record_size(r);
+    n = count / rec;
+    if (count % rec || n > SIMTEMP_MAX_REPLAY - r->stage_len) {
+        ret = count % rec ? -EINVAL : -ENOSPC;
+        goto out;
+    }
+    ret = simtemp_stage_reserve(r, r->stage_len + n);
+    if (ret)
+        goto out;
+
+    if (r->abi == SIMTEMP_ABI_V2) {
+        if (copy_from_user(&r->stage[r->stage_len], buf, n * rec)) {
+            ret = -EFAULT;
+            goto out;
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            if (copy_from_user(&v1, buf + i * rec, rec)) {
+                ret = -EFAULT;
+                goto out;
+            }
+            r->stage[r->stage_len + i].timestamp_ns = v1.timestamp_ns;
+            r->stage[r->stage_len + i].temp_mC = v1.temp_mC;
+            r->stage[r->stage_len + i].flags = v1.flags;
+            r->stage[r->stage_len + i].seq = 0;
+        }
+    }
+    r->stage_len += n;
+    ret = count;
+out:
+    mutex_unlock(&r->lock);
     return ret;
 }
 
 /* Support poll() and select() system calls for async user-space I/O */
 static unsigned int simtemp_poll(struct file *filp, poll_table *wait)
 {
-    struct nxp_simtemp_dev *dev = filp->private_data;
+    struct simtemp_reader *r = filp->private_data;
+    struct nxp_simtemp_dev *dev = r->dev;
     unsigned int mask = 0;
-    unsigned long flags;
+    u32 head, tail;
 
     poll_wait(filp, &dev->wq, wait);
 
-    spin_lock_irqsave(&dev->lock, flags);
-    if (!buf_empty(dev))
+    head = buf_head(dev);
+    tail = reader_tail(r);
+    simtemp_note_occupancy(dev, head, tail);
+    if (READ_ONCE(r->stream) == SIMTEMP_STREAM_AGG ? reader_has_agg(r) : reader_ready(r))
         mask |= POLLIN | POLLRDNORM;
-    if (dev->head != dev->tail) {
-        struct simtemp_sample *s = &dev->buffer[dev->tail];
-        if (s->flags & 2)
-            mask |= POLLPRI;
-    }
-    spin_unlock_irqrestore(&dev->lock, flags);
+    if (reader_has_event(r))
+        mask |= POLLPRI;
 
     return mask;
 }
 
+/* Copy the oldest alert event still queued for this file, like read()
+ * does for samples: clamp a lapped cursor and retry if the producer
+ * overwrote the slot while it was copied. */
+static long simtemp_get_event(struct file *filp, struct simtemp_event __user *uev)
+{
+    struct simtemp_reader *r = filp->private_data;
+    struct nxp_simtemp_dev *dev = r->dev;
+    struct simtemp_event ev;
+    u32 head, start;
+
+    if (mutex_lock_interruptible(&r->lock))
+        return -ERESTARTSYS;
+
+    while (!reader_has_event(r)) {
+        mutex_unlock(&r->lock);
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        if (wait_event_interruptible(dev->wq, reader_has_event(r)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&r->lock))
+            return -ERESTARTSYS;
+    }
+
+    do {
+        head = smp_load_acquire(&dev->ev_head);
+        start = r->ev_tail;
+        if (head - start >= SIMTEMP_EVENT_RING)
+            start = head - SIMTEMP_EVENT_RING + 1;
+        ev = dev->events[start & (SIMTEMP_EVENT_RING - 1)];
+        smp_rmb();
+    } while (READ_ONCE(dev->ev_head) - start >= SIMTEMP_EVENT_RING);
+
+    ev.lost = start - r->ev_tail;
+    if (copy_to_user(uev, &ev, sizeof(ev))) {
+        mutex_unlock(&r->lock);
+        return -EFAULT;
+    }
+    r->ev_tail = start + 1;
+    mutex_unlock(&r->lock);
+    return 0;
+}
+
+static void simtemp_get_config(struct nxp_simtemp_dev *dev, struct simtemp_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->period_ns = ktime_to_ns(dev->period);
+    cfg->wakeup_timeout_ns = ktime_to_ns(dev->wakeup_timeout);
+    cfg->agg_window_ns = ktime_to_ns(dev->agg_window);
+    cfg->threshold_mC = dev->threshold_mC;
+    cfg->threshold_low_mC = dev->threshold_low_mC;
+    cfg->mode = dev->mode;
+    cfg->gen_context = dev->ctx;
+    cfg->cpu = dev->cpu;
+    cfg->batch = dev->batch;
+    cfg->wakeup_watermark = dev->wakeup_watermark;
+}
+
+/* Validate the whole configuration first, then switch it with the
+ * producer stopped: the timer restarts with the new period, context and
+ * CPU, and no sample is generated from a mix of old and new fields. */
+static int simtemp_set_config(struct nxp_simtemp_dev *dev, const struct simtemp_config *cfg)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(cfg->reserved); i++)
+        if (cfg->reserved[i])
+            return -EINVAL;
+    if (cfg->period_ns < SIMTEMP_MIN_PERIOD_NS || cfg->period_ns > KTIME_MAX ||
+        cfg->wakeup_timeout_ns > KTIME_MAX ||
+        cfg->agg_window_ns < SIMTEMP_MIN_PERIOD_NS || cfg->agg_window_ns > KTIME_MAX)
+        return -EINVAL;
+    if (cfg->mode >= SIMTEMP_MODE_COUNT || cfg->gen_context >= SIMTEMP_CTX_COUNT)
+        return -EINVAL;
+    if (cfg->cpu < -1 || cfg->cpu >= (int)nr_cpu_ids)
+        return -EINVAL;
+    if (cfg->batch == 0 || cfg->batch > SIMTEMP_MAX_BATCH ||
+        cfg->wakeup_watermark == 0 || cfg->wakeup_watermark > SIMTEMP_MAX_BUF_SIZE)
+        return -EINVAL;
+
+    cpus_read_lock();
+    if (cfg->cpu >= 0 && !cpu_online(cfg->cpu)) {
+        cpus_read_unlock();
+        return -EINVAL;
+    }
+    mutex_lock(&dev->cfg_lock);
+    simtemp_producer_stop(dev);
+    WRITE_ONCE(dev->period, ns_to_ktime(cfg->period_ns));
+    WRITE_ONCE(dev->wakeup_timeout, ns_to_ktime(cfg->wakeup_timeout_ns));
+    WRITE_ONCE(dev->agg_window, ns_to_ktime(cfg->agg_window_ns));
+    WRITE_ONCE(dev->threshold_mC, cfg->threshold_mC);
+    WRITE_ONCE(dev->threshold_low_mC, cfg->threshold_low_mC);
+    simtemp_set_mode(dev, cfg->mode);
+    WRITE_ONCE(dev->ctx, cfg->gen_context);
+    WRITE_ONCE(dev->cpu, cfg->cpu);
+    dev->offline_cpu = -1;
+    WRITE_ONCE(dev->batch, cfg->batch);
+    WRITE_ONCE(dev->wakeup_watermark, cfg->wakeup_watermark);
+    if (dev->running)
+        simtemp_timer_start(dev);
+    mutex_unlock(&dev->cfg_lock);
+    cpus_read_unlock();
+    return 0;
+}
+
+static long simtemp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct simtemp_reader *r = filp->private_data;
+    struct nxp_simtemp_dev *dev = r->dev;
+    u32 __user *uarg = (u32 __user *)arg;
+    struct simtemp_config cfg;
+    struct simtemp_stats st;
+    u32 val;
+
+    switch (cmd) {
+    case SIMTEMP_IOC_GET_ABI:
+        return put_user(READ_ONCE(r->abi), uarg);
+
+    case SIMTEMP_IOC_SET_ABI:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (val != SIMTEMP_ABI_V1 && val != SIMTEMP_ABI_V2)
+            return -EINVAL;
+        mutex_lock(&r->lock);
+        r->abi = val;
+        mutex_unlock(&r->lock);
+        return 0;
+
+    case SIMTEMP_IOC_GET_EVENT:
+        return simtemp_get_event(filp, (struct simtemp_event __user *)arg);
+
+    case SIMTEMP_IOC_GET_STREAM:
+        return put_user(READ_ONCE(r->stream), uarg);
+
+    case SIMTEMP_IOC_SET_STREAM:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (val != SIMTEMP_STREAM_RAW && val != SIMTEMP_STREAM_AGG)
+            return -EINVAL;
+        mutex_lock(&r->lock);
+        WRITE_ONCE(r->stream, val);
+        mutex_unlock(&r->lock);
+        return 0;
+
+    case SIMTEMP_IOC_GET_CONFIG:
+        mutex_lock(&dev->cfg_lock);
+        simtemp_get_config(dev, &cfg);
+        mutex_unlock(&dev->cfg_lock);
+        return copy_to_user((void __user *)arg, &cfg, sizeof(cfg)) ? -EFAULT : 0;
+
+    case SIMTEMP_IOC_SET_CONFIG:
+        /* Same rights as the sysfs attributes need: a writable open */
+        if (!(filp->f_mode & FMODE_WRITE))
+            return -EBADF;
+        if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+            return -EFAULT;
+        return simtemp_set_config(dev, &cfg);
+
+    case SIMTEMP_IOC_GET_STATS:
+        simtemp_get_stats(dev, &st);
+        return copy_to_user((void __user *)arg, &st, sizeof(st)) ? -EFAULT : 0;
+
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* Map the shared ring (header page + samples, read-only) or this file's
+ * cursor page into user space. Both come from vmalloc_user(), so they
+ * are zeroed and page aligned. */
+static int simtemp_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct simtemp_reader *r = filp->private_data;
+    struct nxp_simtemp_dev *dev = r->dev;
+    unsigned long size = vma->vm_end - vma->vm_start;
+    int ret;
+
+    switch ((u64)vma->vm_pgoff << PAGE_SHIFT) {
+    case SIMTEMP_MMAP_RING_OFF:
+        /* Shared by all readers: nobody may write to it */
+        if (vma->vm_flags & VM_WRITE)
+            return -EPERM;
+        if (size > dev->ring_bytes)
+            return -EINVAL;
+        vm_flags_clear(vma, VM_MAYWRITE);
+        return remap_vmalloc_range(vma, dev->ring, 0);
+
+    case SIMTEMP_MMAP_CURSOR_OFF:
+        if (size > PAGE_SIZE)
+            return -EINVAL;
+        mutex_lock(&r->lock);
+        if (!r->cursor) {
+            r->cursor = vmalloc_user(PAGE_SIZE);
+            if (!r->cursor) {
+                mutex_unlock(&r->lock);
+                return -ENOMEM;
+            }
+            /* From now on read()/poll() follow the user-visible cursor */
+            r->cursor->tail = r->tail;
+            WRITE_ONCE(r->tailp, &r->cursor->tail);
+        }
+        ret = remap_vmalloc_range(vma, r->cursor, 0);
+        mutex_unlock(&r->lock);
+        return ret;
+
+    default:
+        return -EINVAL;
+    }
+}
+
 static const struct file_operations simtemp_fops = {
-    .owner = THIS_MODULE,
-    .open  = simtemp_open,
-    .read  = simtemp_read,
-    .poll  = simtemp_poll,
+    .owner   = THIS_MODULE,
+    .open    = simtemp_open,
+    .release = simtemp_release,
+    .read    = simtemp_read,
+    .write   = simtemp_write,
+    .poll    = simtemp_poll,
+    .mmap    = simtemp_mmap,
+    .unlocked_ioctl = simtemp_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
 };
 
+/* (Re)allocate the shared ring for nr samples (a power of two): one header
+ * page followed by the samples. The region is vmalloc-backed, so rings of
+ * many megabytes need no physically contiguous memory. The producer must
+ * be stopped and no file may be open; on failure the old ring is kept. */
+static int simtemp_ring_alloc(struct nxp_simtemp_dev *dev, unsigned int nr)
+{
+    size_t bytes = PAGE_SIZE + PAGE_ALIGN((size_t)nr * sizeof(struct simtemp_sample));
+    struct simtemp_ring_hdr *ring;
+
+    ring = vmalloc_user(bytes);
+    if (!ring)
+        return -ENOMEM;
+
+    ring->magic = SIMTEMP_RING_MAGIC;
+    ring->version = SIMTEMP_RING_VERSION;
+    ring->nr_samples = nr;
+    ring->sample_size = sizeof(struct simtemp_sample);
+    ring->data_offset = PAGE_SIZE;
+
+    vfree(dev->ring);
+    dev->ring = ring;
+    dev->ring_bytes = bytes;
+    dev->buffer = (struct simtemp_sample *)((char *)ring + PAGE_SIZE);
+    dev->buf_size = nr;
+    dev->buf_mask = nr - 1;
+    dev->head = 0;
+    dev->wake_head = 0;
+    return 0;
+}
+
 /* ============================================================
  *                 PLATFORM DRIVER IMPLEMENTATION
  * ============================================================ */
 
+/* Start-up configuration of one sensor, see the module parameters */
+struct simtemp_init_cfg {
+    u64 period_ns;
+    unsigned int buf_size;
+    s32 threshold_mC;
+    int cpu;
+    int mode;
+};
+
+/* Value given for sensor idx: its own array entry, else a single value
+ * given for all, else nothing (false) */
+static bool simtemp_param(unsigned int nr, unsigned int idx, unsigned int *slot)
+{
+    if (idx < nr)
+        *slot = idx;
+    else if (nr == 1)
+        *slot = 0;
+    else
+        return false;
+    return true;
+}
+
+/* Built-in defaults, overridden by the module parameters, overridden by
+ * the device properties (DT). Out of range values are reported and left
+ * at the previous level. */
+static void simtemp_init_config(struct device *d, unsigned int idx, int def_cpu,
+                                struct simtemp_init_cfg *cfg)
+{
+    struct device_node *np;
+    const char *str = NULL;
+    unsigned int i;
+    u32 val;
+
+    cfg->period_ns = SIMTEMP_DEFAULT_PERIOD_NS;
+    cfg->buf_size = SIMTEMP_DEFAULT_BUF_SIZE;
+    cfg->threshold_mC = 45000;
+    cfg->cpu = def_cpu;
+    cfg->mode = SIMTEMP_MODE_NORMAL;
+
+    if (simtemp_param(nr_buffer_size, idx, &i))
+        cfg->buf_size = buffer_size_param[i];
+    if (simtemp_param(nr_sampling_ns, idx, &i))
+        cfg->period_ns = sampling_ns_param[i];
+    if (simtemp_param(nr_threshold_mC, idx, &i))
+        cfg->threshold_mC = threshold_mC_param[i];
+    if (simtemp_param(nr_cpu, idx, &i))
+        cfg->cpu = cpu_param[i];
+    if (simtemp_param(nr_mode, idx, &i))
+        str = mode_param[i];
+
+    if (!device_property_read_u32(d, "nxp,buffer-size", &val))
+        cfg->buf_size = val;
+    if (!device_property_read_u32(d, "nxp,sampling-ns", &val))
+        cfg->period_ns = val;
+    if (!device_property_read_u32(d, "nxp,threshold-millicelsius", &val))
+        cfg->threshold_mC = (s32)val;
+    device_property_read_string(d, "nxp,mode", &str);
+
+    /* cpu is a phandle to a /cpus node, only available from DT */
+    np = of_parse_phandle(dev_of_node(d), "cpu", 0);
+    if (np) {
+        int cpu = of_cpu_node_to_id(np);
+
+        if (cpu < 0)
+            dev_warn(d, "cpu %pOF is not a possible CPU, ignored\n", np);
+        else
+            cfg->cpu = cpu;
+        of_node_put(np);
+    }
+
+    if (cfg->buf_size < SIMTEMP_MIN_BUF_SIZE || cfg->buf_size > SIMTEMP_MAX_BUF_SIZE) {
+        dev_warn(d, "buffer_size %u out of range, using %u\n",
+                 cfg->buf_size, SIMTEMP_DEFAULT_BUF_SIZE);
+        cfg->buf_size = SIMTEMP_DEFAULT_BUF_SIZE;
+    }
+    if (cfg->period_ns < SIMTEMP_MIN_PERIOD_NS || cfg->period_ns > KTIME_MAX) {
+        dev_warn(d, "sampling period %llu ns out of range, using %llu\n",
+                 cfg->period_ns, (u64)SIMTEMP_DEFAULT_PERIOD_NS);
+        cfg->period_ns = SIMTEMP_DEFAULT_PERIOD_NS;
+    }
+    if (cfg->cpu < -1 || cfg->cpu >= (int)nr_cpu_ids ||
+        (cfg->cpu >= 0 && !cpu_online(cfg->cpu))) {
+        dev_warn(d, "cpu %d not online, using %d\n", cfg->cpu, def_cpu);
+        cfg->cpu = def_cpu;
+    }
+    if (str) {
+        cfg->mode = sysfs_match_string(simtemp_mode_names, str);
+        if (cfg->mode < 0) {
+            dev_warn(d, "unknown mode \"%s\", using normal\n", str);
+            cfg->mode = SIMTEMP_MODE_NORMAL;
+        }
+    }
+}
+
 static int nxp_simtemp_probe(struct platform_device *pdev)
 {
+    struct simtemp_init_cfg cfg;
+    struct nxp_simtemp_dev *dev;
+    unsigned int idx;
     int ret;
 
-    pr_info(DRIVER_NAME ": probe called\n");
+    pr_info(DRIVER_NAME ": probe called for %s\n", dev_name(&pdev->dev));
 
     /* Allocate and initialize driver context */
-    gdev = kzalloc(sizeof(*gdev), GFP_KERNEL);
-    if (!gdev)
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
         return -ENOMEM;
 
-    gdev->buf_size = 64;
-    gdev->buffer = kcalloc(gdev->buf_size, sizeof(struct simtemp_sample), GFP_KERNEL);
-    if (!gdev->buffer) {
-        kfree(gdev);
-        return -ENOMEM;
+    /*
+     * A single legacy instance keeps /dev/simtemp; numbered instances get
+     * simtempN. Device tree nodes have no platform id, so they are
+     * numbered after the percpu sensors (if any) in probe order.
+     */
+    dev->dt_id = -1;
+    if (dev_of_node(&pdev->dev)) {
+        unsigned int first = percpu ? nr_cpu_ids : 0;
+
+        ret = ida_alloc_range(&simtemp_dt_ida, first, first + SIMTEMP_MAX_SENSORS - 1,
+                              GFP_KERNEL);
+        if (ret < 0) {
+            kfree(dev);
+            return ret;
+        }
+        dev->dt_id = ret;
+        snprintf(dev->name, sizeof(dev->name), DEV_NAME "%d", dev->dt_id);
+        idx = dev->dt_id;
+    } else if (pdev->id == PLATFORM_DEVID_NONE) {
+        strscpy(dev->name, DEV_NAME, sizeof(dev->name));
+        idx = 0;
+    } else {
+        snprintf(dev->name, sizeof(dev->name), DEV_NAME "%d", pdev->id);
+        idx = pdev->id;
     }
+    dev->pdev = pdev;
 
-    spin_lock_init(&gdev->lock);
-    init_waitqueue_head(&gdev->wq);
-    INIT_WORK(&gdev->work, simtemp_work_func);
-
-    gdev->sampling_ms = 1000;
-    gdev->threshold_mC = 45000;
-    gdev->running = true;
-    strscpy(gdev->mode, "normal", sizeof(gdev->mode));
+    /* percpu instances are numbered by CPU and pinned to it by default */
+    simtemp_init_config(&pdev->dev, idx, percpu && dev->dt_id < 0 ? pdev->id : -1, &cfg);
 
-    /* Initialize stats */
-    gdev->stats.updates = 0;
-    gdev->stats.alerts = 0;
-    gdev->stats.last_error = 0;
+    ret = simtemp_ring_alloc(dev, roundup_pow_of_two(cfg.buf_size));
+    if (ret)
+        goto err_free;
 
-    /* Configure and start timer */
-    hrtimer_init(&gdev->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-    gdev->timer.function = simtemp_timer_cb;
-    hrtimer_start(&gdev->timer, ms_to_ktime(gdev->sampling_ms), HRTIMER_MODE_REL);
-
-    /* Register misc device under /dev/simtemp */
-    gdev->misc.minor = MISC_DYNAMIC_MINOR;
-    gdev->misc.name = DEV_NAME;
-    gdev->misc.fops = &simtemp_fops;
-    ret = misc_register(&gdev->misc);
-    if (ret) {
-        kfree(gdev->buffer);
-        kfree(gdev);
-        return ret;
+    dev->gen_wq = alloc_workqueue(DRIVER_NAME "/%s", WQ_HIGHPRI | WQ_UNBOUND, 0, dev->name);
+    if (!dev->gen_wq) {
+        ret = -ENOMEM;
+        goto err_ring;
     }
 
-    /* Create sysfs attributes */
-    ret = sysfs_create_file(&gdev->misc.this_device->kobj, &sampling_ms_attr.attr);
-    if (ret)
-        dev_warn(&pdev->dev, "failed to create sampling_ms sysfs file\n");
+    mutex_init(&dev->cfg_lock);
+    init_waitqueue_head(&dev->wq);
+    INIT_WORK(&dev->work, simtemp_work_func);
+    dev->ctx = SIMTEMP_CTX_WORKQUEUE;
+    dev->cpu = cfg.cpu;
+    dev->offline_cpu = -1;
+
+    dev->period = ns_to_ktime(cfg.period_ns);
+    dev->batch = 1;
+    dev->wakeup_watermark = 1;
+    dev->agg_window = ns_to_ktime(SIMTEMP_DEFAULT_AGG_WINDOW);
+    dev->threshold_mC = cfg.threshold_mC;
+    dev->threshold_low_mC = cfg.threshold_mC;
+    dev->running = true;
+    dev->wave.base_mC = SIMTEMP_WAVE_BASE_MILLIC;
+    dev->wave.amplitude_mC = SIMTEMP_WAVE_AMPLITUDE_MILLIC;
+    dev->wave.period = SIMTEMP_WAVE_PERIOD;
+    dev->wave.tau = SIMTEMP_WAVE_TAU;
+    dev->replay_speed = 1;
+    simtemp_seed(dev, get_random_u64());
+    simtemp_set_mode(dev, cfg.mode);
 
-    ret = sysfs_create_file(&gdev->misc.this_device->kobj, &threshold_mC_attr.attr);
-    if (ret)
-        dev_warn(&pdev->dev, "failed to create threshold_mC sysfs file\n");
+    /* Initialize stats */
+    atomic64_set(&dev->stats.updates, 0);
+    atomic64_set(&dev->stats.alerts, 0);
+    dev->stats.last_error = 0;
+    atomic64_set(&dev->stats.missed, 0);
+    atomic64_set(&dev->stats.overruns, 0);
+    atomic64_set(&dev->stats.coalesced, 0);
+    atomic64_set(&dev->stats.dropped, 0);
+    atomic64_set(&dev->stats.consumed, 0);
+    atomic64_set(&dev->stats.wakeups, 0);
+    atomic64_set(&dev->stats.lat_min_ns, 0);
+    atomic64_set(&dev->stats.lat_max_ns, 0);
+    atomic_set(&dev->stats.high_water, 0);
+    seqcount_init(&dev->pub_seq);
+    dev->pub_head = dev->head;
+
+    /*
+     * Join the hotplug state before the timer can run on a pinned CPU.
+     * Holding the hotplug lock across it keeps the CPU checked by
+     * simtemp_init_config() from going away unnoticed; one that already
+     * went is handled as if it went offline now.
+     */
+    cpus_read_lock();
+    ret = cpuhp_state_add_instance_nocalls_cpuslocked(simtemp_cpuhp_state, &dev->cpuhp_node);
+    if (ret) {
+        cpus_read_unlock();
+        goto err_wq;
+    }
+    if (dev->cpu >= 0 && !cpu_online(dev->cpu)) {
+        dev->offline_cpu = dev->cpu;
+        dev->cpu = -1;
+    }
 
-    ret = sysfs_create_file(&gdev->misc.this_device->kobj, &mode_attr.attr);
+    /* Configure and start timer */
+    simtemp_timer_start(dev);
+    cpus_read_unlock();
+
+    /* Register misc device under /dev/<name> */
+    dev->misc.minor = MISC_DYNAMIC_MINOR;
+    dev->misc.name = dev->name;
+    dev->misc.fops = &simtemp_fops;
+    dev->misc.parent = &pdev->dev;
+    ret = misc_register(&dev->misc);
     if (ret)
-        dev_warn(&pdev->dev, "failed to create mode sysfs file\n");
+        goto err_cpuhp;
 
-    ret = sysfs_create_file(&gdev->misc.this_device->kobj, &stats_attr.attr);
+    /* Create sysfs attributes */
+    ret = sysfs_create_files(&dev->misc.this_device->kobj, simtemp_attrs);
+    if (!ret)
+        ret = sysfs_create_bin_file(&dev->misc.this_device->kobj, &lut_attr);
+    if (!ret)
+        ret = sysfs_create_bin_file(&dev->misc.this_device->kobj, &stats_bin_attr);
     if (ret)
-        dev_warn(&pdev->dev, "failed to create stats sysfs file\n");
+        dev_warn(&pdev->dev, "failed to create sysfs files\n");
+    simtemp_debugfs_add(dev);
 
-    pr_info(DRIVER_NAME ": /dev/%s ready\n", DEV_NAME);
+    platform_set_drvdata(pdev, dev);
+    pr_info(DRIVER_NAME ": /dev/%s ready\n", dev->name);
     return 0;
+
+err_cpuhp:
+    /* Leave the hotplug state first so no callback restarts the timer */
+    cpuhp_state_remove_instance_nocalls(simtemp_cpuhp_state, &dev->cpuhp_node);
+    simtemp_producer_stop(dev);
+err_wq:
+    destroy_workqueue(dev->gen_wq);
+err_ring:
+    vfree(dev->ring);
+err_free:
+    if (dev->dt_id >= 0)
+        ida_free(&simtemp_dt_ida, dev->dt_id);
+    kfree(dev);
+    return ret;
 }
 
 /* Cleanup on driver removal */
 static void nxp_simtemp_remove(struct platform_device *pdev)
 {
-    struct nxp_simtemp_dev *dev = gdev;
+    struct nxp_simtemp_dev *dev = platform_get_drvdata(pdev);
 
-    pr_info(DRIVER_NAME ": remove called\n");
+    pr_info(DRIVER_NAME ": remove called for /dev/%s\n", dev->name);
 
-    dev->running = false;
-    hrtimer_cancel(&dev->timer);
-    cancel_work_sync(&dev->work);
+    /* Remove sysfs attributes and the hotplug instance first so nothing
+     * can re-arm the timer */
+    cpuhp_state_remove_instance_nocalls(simtemp_cpuhp_state, &dev->cpuhp_node);
+    debugfs_remove_recursive(dev->debugfs);
+    sysfs_remove_bin_file(&dev->misc.this_device->kobj, &stats_bin_attr);
+    sysfs_remove_bin_file(&dev->misc.this_device->kobj, &lut_attr);
+    sysfs_remove_files(&dev->misc.this_device->kobj, simtemp_attrs);
 
-    /* Remove sysfs attributes */
-    sysfs_remove_file(&dev->misc.this_device->kobj, &sampling_ms_attr.attr);
-    sysfs_remove_file(&dev->misc.this_device->kobj, &threshold_mC_attr.attr);
-    sysfs_remove_file(&dev->misc.this_device->kobj, &mode_attr.attr);
-    sysfs_remove_file(&dev->misc.this_device->kobj, &stats_attr.attr);
+    dev->running = false;
+    simtemp_producer_stop(dev);
 
     misc_deregister(&dev->misc);
 
-    kfree(dev->buffer);
+    destroy_workqueue(dev->gen_wq);
+    vfree(dev->replay);
+    vfree(dev->lut);
+    vfree(dev->ring);
+    if (dev->dt_id >= 0)
+        ida_free(&simtemp_dt_ida, dev->dt_id);
     kfree(dev);
-    gdev = NULL;
 
     pr_info(DRIVER_NAME ": device removed\n");
 }
@@ -345,42 +2405,118 @@ static void nxp_simtemp_remove(struct platform_device *pdev)
  *                 DRIVER REGISTRATION
  * ============================================================ */
 
+static const struct of_device_id nxp_simtemp_of_match[] = {
+    { .compatible = "nxp,simtemp" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, nxp_simtemp_of_match);
+
 static struct platform_driver nxp_simtemp_driver = {
     .probe  = nxp_simtemp_probe,
     .remove = nxp_simtemp_remove,
     .driver = {
         .name = DRIVER_NAME,
         .owner = THIS_MODULE,
-        .of_match_table = NULL,  /* No Device Tree binding used */
+        .of_match_table = nxp_simtemp_of_match,
     },
 };
 
-static struct platform_device *nxp_simtemp_pdev;
+static struct platform_device **nxp_simtemp_pdevs;
+static unsigned int nxp_simtemp_npdevs;
+
+static void nxp_simtemp_unregister_devices(void)
+{
+    while (nxp_simtemp_npdevs)
+        platform_device_unregister(nxp_simtemp_pdevs[--nxp_simtemp_npdevs]);
+    kfree(nxp_simtemp_pdevs);
+    nxp_simtemp_pdevs = NULL;
+}
+
+static int nxp_simtemp_add_device(int id)
+{
+    struct platform_device *pdev;
+
+    pdev = platform_device_register_simple(DRIVER_NAME, id, NULL, 0);
+    if (IS_ERR(pdev))
+        return PTR_ERR(pdev);
+    nxp_simtemp_pdevs[nxp_simtemp_npdevs++] = pdev;
+    return 0;
+}
 
 static int __init nxp_simtemp_init(void)
 {
-    int ret;
+    struct device_node *np;
+    unsigned int i, max;
+    bool dt = false;
+    int ret = 0;
+    int c;
+
+    if (!percpu && (num_sensors == 0 || num_sensors > SIMTEMP_MAX_SENSORS)) {
+        pr_err(DRIVER_NAME ": num_sensors must be 1..%u\n", SIMTEMP_MAX_SENSORS);
+        return -EINVAL;
+    }
+
+    max = percpu ? nr_cpu_ids : num_sensors;
+    nxp_simtemp_pdevs = kcalloc(max, sizeof(*nxp_simtemp_pdevs), GFP_KERNEL);
+    if (!nxp_simtemp_pdevs)
+        return -ENOMEM;
+
+    ret = cpuhp_setup_state_multi(CPUHP_AP_ONLINE_DYN, DRIVER_NAME ":online",
+                                  simtemp_cpu_online, simtemp_cpu_offline);
+    if (ret < 0) {
+        kfree(nxp_simtemp_pdevs);
+        return ret;
+    }
+    simtemp_cpuhp_state = ret;
+
+    simtemp_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
 
-    /* Register driver and create a synthetic platform device */
+    /* Register driver and create the synthetic platform devices */
     ret = platform_driver_register(&nxp_simtemp_driver);
-    if (ret)
+    if (ret) {
+        debugfs_remove_recursive(simtemp_debugfs_root);
+        cpuhp_remove_multi_state(simtemp_cpuhp_state);
+        kfree(nxp_simtemp_pdevs);
         return ret;
+    }
+
+    /* Sensors described by the device tree replace the synthetic ones */
+    np = of_find_compatible_node(NULL, NULL, "nxp,simtemp");
+    if (np) {
+        of_node_put(np);
+        dt = true;
+    }
 
-    nxp_simtemp_pdev = platform_device_register_simple("nxp_simtemp", -1, NULL, 0);
-    if (IS_ERR(nxp_simtemp_pdev)) {
+    /* In percpu mode /dev/simtempN is the sensor pinned to CPU N */
+    if (percpu) {
+        for_each_online_cpu(c) {
+            ret = nxp_simtemp_add_device(c);
+            if (ret)
+                break;
+        }
+    } else if (!dt) {
+        for (i = 0; i < num_sensors && !ret; i++)
+            ret = nxp_simtemp_add_device(num_sensors == 1 ? PLATFORM_DEVID_NONE : i);
+    }
+    if (ret) {
+        nxp_simtemp_unregister_devices();
         platform_driver_unregister(&nxp_simtemp_driver);
-        return PTR_ERR(nxp_simtemp_pdev);
+        debugfs_remove_recursive(simtemp_debugfs_root);
+        cpuhp_remove_multi_state(simtemp_cpuhp_state);
+        return ret;
     }
 
-    pr_info(DRIVER_NAME ": platform driver registered\n");
+    pr_info(DRIVER_NAME ": platform driver registered (%u sensors%s%s)\n",
+            nxp_simtemp_npdevs, percpu ? ", per CPU" : "", dt ? ", plus device tree" : "");
     return 0;
 }
 
 static void __exit nxp_simtemp_exit(void)
 {
-    if (nxp_simtemp_pdev)
-        platform_device_unregister(nxp_simtemp_pdev);
+    nxp_simtemp_unregister_devices();
     platform_driver_unregister(&nxp_simtemp_driver);
+    debugfs_remove_recursive(simtemp_debugfs_root);
+    cpuhp_remove_multi_state(simtemp_cpuhp_state);
     pr_info(DRIVER_NAME ": platform driver unregistered\n");
 }
 
@@ -5,14 +5,48 @@
 #include <linux/miscdevice.h>
 #include <linux/hrtimer.h>
 #include <linux/workqueue.h>
-#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
+#include <linux/prandom.h>
+#include <linux/seqlock.h>
 #include <linux/wait.h>
 #include <linux/platform_device.h>
+#include <linux/list.h>
+
+#include "nxp_simtemp_uapi.h"
 
 /* ================== Defines ================== */
 #define DRIVER_NAME "nxp_simtemp"
 #define DEV_NAME "simtemp"
 
+/* --- Instances --- */
+#define SIMTEMP_MAX_SENSORS 256
+
+/* --- Sampling Period --- */
+#define SIMTEMP_DEFAULT_PERIOD_NS (1000 * NSEC_PER_MSEC)
+#define SIMTEMP_MIN_PERIOD_NS     (10 * NSEC_PER_USEC)   // 100 kHz
+
+/* --- Samples generated per timer expiry --- */
+#define SIMTEMP_MAX_BATCH 1024
+
+/* --- Latency histograms (debugfs): bucket b counts [2^b, 2^(b+1)) ns --- */
+#define SIMTEMP_HIST_BUCKETS 32           // Last bucket: >= 2^31 ns (~2.1 s)
+
+/* --- Temperatures generated per generator call (on-stack chunk) --- */
+#define SIMTEMP_GEN_CHUNK 64
+
+/* --- Alert event queue (entries, power of two) --- */
+#define SIMTEMP_EVENT_RING 64
+
+/* --- Aggregated windows (queue entries, power of two) --- */
+#define SIMTEMP_AGG_RING           256
+#define SIMTEMP_DEFAULT_AGG_WINDOW (1000 * NSEC_PER_MSEC)
+
+/* --- Ring Buffer Size (samples, rounded up to a power of two) --- */
+#define SIMTEMP_DEFAULT_BUF_SIZE 64
+#define SIMTEMP_MIN_BUF_SIZE     16
+#define SIMTEMP_MAX_BUF_SIZE     (1U << 22)   // 96 MiB of 24-byte samples
+
 /* --- Modes Temp Config --- */
 #define RAMP_START_MILLIC 40000
 #define RAMP_STEP_MILLIC  100
@@ -24,39 +58,143 @@
 #define NORMAL_MEAN_MILLIC 40000
 #define NORMAL_DELTA_MILLIC 1000  // ±
 
+/* --- Waveform generators (sine, step, rc, gaussian, lut) --- */
+#define SIMTEMP_WAVE_BASE_MILLIC      40000
+#define SIMTEMP_WAVE_AMPLITUDE_MILLIC 5000
+#define SIMTEMP_WAVE_PERIOD           1000      // samples per waveform period
+#define SIMTEMP_WAVE_TAU              100       // RC time constant in samples
+#define SIMTEMP_MAX_WAVE_PERIOD       (1U << 18) // fixp_sin32_rad() limit
+#define SIMTEMP_MAX_LUT               65536     // lookup table entries (s32 mC)
+
+/* --- Replay of recorded samples --- */
+#define SIMTEMP_MAX_REPLAY (1U << 22)   // records in a loaded trace (96 MiB)
+
 /* ================== Data Structures ================== */
 
-/* Structure representing one temperature sample */
-struct simtemp_sample {
-    __u64 timestamp_ns;  /* Nanosecond timestamp */
-    __s32 temp_mC;       /* Temperature in millidegrees Celsius */
-    __u32 flags;         /* Bitfield with status flags */
-} __attribute__((packed));
+struct nxp_simtemp_dev;
+
+/* Generator operations, one table entry per enum simtemp_mode
+ * (named by simtemp_mode_names[]) */
+struct simtemp_gen_ops {
+    void (*fill)(struct nxp_simtemp_dev *dev, s32 *temp_mC, unsigned int n); // Next n temperatures (producer context)
+    void (*emit)(struct nxp_simtemp_dev *dev, ktime_t ts); // Or: push whole samples due by ts
+};
+
+/* Waveform parameters, set through the waveform attribute. Times are
+ * in samples, so waveforms are deterministic whatever the sample rate. */
+struct simtemp_wave_cfg {
+    s32 base_mC;                      // Mean / low level
+    s32 amplitude_mC;                 // Sine amplitude, step height
+    u32 period;                       // Samples per sine / step period
+    u32 tau;                          // RC time constant
+    s32 noise_mC;                     // Gaussian noise sigma added to every waveform
+};
+
+/* log2 latency histogram, updated lock-free from any context */
+struct simtemp_hist {
+    atomic64_t bucket[SIMTEMP_HIST_BUCKETS];
+};
 
 /* Main device structure */
 struct nxp_simtemp_dev {
     struct miscdevice misc;           // Misc device registration
+    char name[16];                    // Node name: "simtemp" or "simtempN"
     struct hrtimer timer;             // High-resolution timer for sampling
     struct work_struct work;          // Workqueue to simulate readings
-    spinlock_t lock;                  // Protects buffer access
+    struct workqueue_struct *gen_wq;  // Dedicated high-priority queue (SIMTEMP_CTX_HIGHPRI)
+    enum simtemp_ctx ctx;             // Where samples are generated
+    int cpu;                          // CPU the timer and work are pinned to, -1 if unpinned
+    int offline_cpu;                  // Pinned CPU that went offline, re-pinned when it returns
+    struct hlist_node cpuhp_node;     // Instance of simtemp_cpuhp_state
+    ktime_t work_expiry;              // Timer expiry the pending work item stands for
+    struct mutex cfg_lock;            // Serializes reconfiguration from sysfs
     wait_queue_head_t wq;             // For blocking reads
-    struct simtemp_sample *buffer;    // Circular buffer for samples
-    unsigned int buf_size;            // Buffer size
-    unsigned int head;                // Write index 
-    unsigned int tail;                // Read index
-    unsigned int sampling_ms;         // Sampling period
+    struct simtemp_ring_hdr *ring;    // mmap-able region: header page + samples
+    size_t ring_bytes;                // Size of the ring region (page multiple)
+    struct simtemp_sample *buffer;    // Circular buffer for samples (inside ring)
+    unsigned int buf_size;            // Buffer size (power of two)
+    unsigned int buf_mask;            // buf_size - 1, maps a counter to its slot
+    atomic_t open_count;              // Open files; the ring can't be resized while > 0
+    u32 head;                         // Free-running write counter (release-stored, mirrored to ring->head)
+    u64 seq;                          // Sequence number of the next sample
+    u32 wake_head;                    // head at the last reader wakeup: samples released to readers
+    unsigned int wakeup_watermark;    // Wake readers once this many samples are pending
+    ktime_t wakeup_timeout;           // ...or once the oldest pending sample is this old (0 = off)
+    ktime_t period;                   // Sampling period (ns resolution)
+    unsigned int batch;               // Samples per timer expiry (timer fires every batch * period)
     s32 threshold_mC;                 // Alert threshold
-    bool running;                     // Sampling active flag 
+    s32 threshold_low_mC;             // Alert clears below this (hysteresis, <= threshold_mC)
+    bool alert_active;                // Alert state after the last sample (producer)
+    struct simtemp_event events[SIMTEMP_EVENT_RING]; // Broadcast queue of alert edges
+    u32 ev_head;                      // Free-running event write counter (release-stored)
+    u32 wake_ev_head;                 // ev_head at the last reader wakeup
+    ktime_t agg_window;               // Aggregation window length
+    struct simtemp_agg agg_cur;       // Window being accumulated (producer)
+    s64 agg_sum;                      // Sum of agg_cur's temperatures
+    struct simtemp_agg aggs[SIMTEMP_AGG_RING]; // Broadcast queue of closed windows
+    u32 agg_head;                     // Free-running window write counter (release-stored)
+    u32 wake_agg_head;                // agg_head at the last reader wakeup
+    bool running;                     // Sampling active flag (running attribute)
+    bool restarted;                   // Timer (re)started: flag the next sample (producer)
 
-    char mode[16];                    // Mode: "normal", "noisy", "ramp"
-    struct {
-        u32 updates;
-        u32 alerts;
+    enum simtemp_mode mode;           // Selected generator
+    const struct simtemp_gen_ops *gen; // Ops of mode, published with WRITE_ONCE()
+    s32 ramp_mC;                      // Ramp generator state
+    struct simtemp_wave_cfg wave;     // Waveform parameters
+    u32 wave_pos;                     // Position within the waveform period / LUT
+    s64 rc_uC;                        // RC model temperature in micro-degrees
+    s32 *lut;                         // Lookup table (SIMTEMP_MAX_LUT entries, allocated on first write)
+    u32 lut_len;                      // Valid entries in lut
+    struct simtemp_sample *replay;    // Loaded trace (vmalloc), replaced only with the producer stopped
+    u32 replay_len;                   // Records in replay
+    u32 replay_pos;                   // Next record to emit
+    ktime_t replay_t0;                // Time the current pass started
+    u32 replay_speed;                 // Playback speed factor, 0 = one batch per expiry
+    struct rnd_state rnd;             // Fast non-cryptographic PRNG for the noise generators
+    u64 seed;                         // Seed rnd was last initialized with
+    struct {                          // 64-bit, updated once per batch / read() call
+        atomic64_t updates;           // Samples produced
+        atomic64_t alerts;
         u32 last_error;
+        atomic64_t missed;            // Sample periods skipped (hrtimer overruns * batch)
+        atomic64_t overruns;          // Timer expiries skipped by late callbacks
+        atomic64_t coalesced;         // Ticks merged into an already pending work item
+        atomic64_t dropped;           // Samples readers lost to ring overruns
+        atomic64_t consumed;          // Samples returned by read()
+        atomic64_t wakeups;           // Reader wakeups issued by the producer
+        atomic64_t lat_min_ns;        // Producer latency, timer expiry to batch published
+        atomic64_t lat_max_ns;
+        atomic_t high_water;          // Highest ring occupancy seen by a reader
     } stats;
 
+    seqcount_t pub_seq;               // Pairs pub_head with pub_time (single writer: producer)
+    u32 pub_head;                     // head after the last published batch
+    ktime_t pub_time;                 // When that batch was published
+    struct simtemp_hist jitter_hist;  // Timer callback run time - programmed expiry
+    struct simtemp_hist publish_hist; // Timer expiry -> batch published
+    struct simtemp_hist read_hist;    // Batch published -> copied to user by read()
+    struct dentry *debugfs;           // <debugfs>/nxp_simtemp/<name>/
+
     struct kobject *kobj;             // For sysfs exposure
     struct platform_device *pdev;     // Associated platform device
+    int dt_id;                        // Device tree instance number (simtemp_dt_ida), -1 if none
+};
+
+/* Per-open-file consumer state: each file has its own cursor into the
+ * broadcast ring, so every reader sees every sample */
+struct simtemp_reader {
+    struct nxp_simtemp_dev *dev;      // Device this file reads from
+    struct mutex lock;                // Serializes read()/mmap() on this file
+    u32 abi;                          // Record layout returned by read() (SIMTEMP_ABI_*)
+    u32 tail;                         // Read cursor while no cursor page is mapped
+    u32 *tailp;                       // &tail, or &cursor->tail once mapped
+    struct simtemp_ring_cursor *cursor; // mmap-able cursor page (allocated on demand)
+    u32 ev_tail;                      // Next alert event to deliver
+    u32 stream;                       // What read() returns (SIMTEMP_STREAM_*)
+    u32 agg_tail;                     // Next aggregated window to deliver
+    struct simtemp_sample *stage;     // Trace being written, handed to the device on release
+    u32 stage_len;                    // Records in stage
+    u32 stage_cap;                    // Capacity of stage in records
 };
 
 #endif /* NXP_SIMTEMP_H */
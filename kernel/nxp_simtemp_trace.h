@@ -0,0 +1,77 @@
+/* Tracepoints for the nxp_simtemp driver.
+ *
+ * Usage:
+ *   echo 1 > /sys/kernel/tracing/events/nxp_simtemp/enable
+ *   cat /sys/kernel/tracing/trace_pipe
+ * or: perf record -e 'nxp_simtemp:*'
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nxp_simtemp
+
+#if !defined(_NXP_SIMTEMP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _NXP_SIMTEMP_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "nxp_simtemp_uapi.h"
+
+/* Emitted for every sample pushed to the ring */
+TRACE_EVENT(simtemp_sample,
+    TP_PROTO(int minor, const struct simtemp_sample *s, u32 head),
+    TP_ARGS(minor, s, head),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u64, seq)
+        __field(u64, timestamp_ns)
+        __field(s32, temp_mC)
+        __field(u32, flags)
+        __field(u32, head)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->seq = s->seq;
+        __entry->timestamp_ns = s->timestamp_ns;
+        __entry->temp_mC = s->temp_mC;
+        __entry->flags = s->flags;
+        __entry->head = head;
+    ),
+
+    TP_printk("minor=%d seq=%llu ts=%llu temp_mC=%d flags=0x%x head=%u",
+              __entry->minor, __entry->seq, __entry->timestamp_ns, __entry->temp_mC,
+              __entry->flags, __entry->head)
+);
+
+/* Emitted for samples above the alert threshold */
+TRACE_EVENT(simtemp_alert,
+    TP_PROTO(int minor, const struct simtemp_sample *s, s32 threshold_mC),
+    TP_ARGS(minor, s, threshold_mC),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u64, timestamp_ns)
+        __field(s32, temp_mC)
+        __field(s32, threshold_mC)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->timestamp_ns = s->timestamp_ns;
+        __entry->temp_mC = s->temp_mC;
+        __entry->threshold_mC = threshold_mC;
+    ),
+
+    TP_printk("minor=%d ts=%llu temp_mC=%d threshold_mC=%d",
+              __entry->minor, __entry->timestamp_ns, __entry->temp_mC,
+              __entry->threshold_mC)
+);
+
+#endif /* _NXP_SIMTEMP_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nxp_simtemp_trace
+#include <trace/define_trace.h>
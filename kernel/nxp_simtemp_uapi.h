@@ -0,0 +1,237 @@
+#ifndef NXP_SIMTEMP_UAPI_H
+#define NXP_SIMTEMP_UAPI_H
+
+/*
+ * User-space ABI of the nxp_simtemp driver.
+ *
+ * This header only depends on <linux/types.h> so it can be included
+ * both by the kernel module and by user-space consumers.
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* ================== Sample Record ================== */
+
+/* Sample flag bits */
+#define SIMTEMP_FLAG_NEW     0x1  /* Always set on a generated sample */
+#define SIMTEMP_FLAG_ALERT   0x2  /* temp_mC above threshold_mC */
+#define SIMTEMP_FLAG_DROPPED 0x4  /* Samples were lost right before this one (read() only) */
+#define SIMTEMP_FLAG_RESTART 0x8  /* First sample after sampling (re)started, e.g. with a new period */
+
+/*
+ * Record layouts returned by read(). Each open file starts with
+ * SIMTEMP_ABI_V1 so existing readers keep working; a reader opts into a
+ * newer layout with SIMTEMP_IOC_SET_ABI. Both layouts are naturally
+ * aligned and share the same 16-byte prefix.
+ */
+#define SIMTEMP_ABI_V1 1   /* struct simtemp_sample_v1, 16 bytes */
+#define SIMTEMP_ABI_V2 2   /* struct simtemp_sample, 24 bytes */
+
+/* Legacy record (ABI v1) */
+struct simtemp_sample_v1 {
+    __u64 timestamp_ns;  /* Nanosecond timestamp */
+    __s32 temp_mC;       /* Temperature in millidegrees Celsius */
+    __u32 flags;         /* Bitfield with status flags */
+};
+
+/* Structure representing one temperature sample (ABI v2) */
+struct simtemp_sample {
+    __u64 timestamp_ns;  /* Nanosecond timestamp */
+    __s32 temp_mC;       /* Temperature in millidegrees Celsius */
+    __u32 flags;         /* Bitfield with status flags */
+    __u64 seq;           /* Per-device sequence number, +1 per generated sample */
+};
+
+/* ================== Alert Events ================== */
+
+/*
+ * Alert state changes with hysteresis: the alert rises on the first
+ * sample above threshold_mC and falls on the first sample below
+ * threshold_low_mC. Each edge is queued once per device and delivered
+ * to every open file through SIMTEMP_IOC_GET_EVENT; POLLPRI means an
+ * event is pending on that file. A reader that falls more than the
+ * event queue behind loses the oldest events and is told how many.
+ */
+#define SIMTEMP_EVENT_RISING  1
+#define SIMTEMP_EVENT_FALLING 2
+
+struct simtemp_event {
+    __u64 timestamp_ns;  /* Timestamp of the sample that caused the edge */
+    __s32 temp_mC;       /* Its temperature */
+    __u32 type;          /* SIMTEMP_EVENT_* */
+    __u64 seq;           /* Its sequence number */
+    __u32 lost;          /* Events this file missed right before this one */
+    __u32 reserved;
+};
+
+/* ================== Aggregated Stream ================== */
+
+/*
+ * A file switched to SIMTEMP_STREAM_AGG with SIMTEMP_IOC_SET_STREAM gets
+ * one struct simtemp_agg per agg_window_ns window from read() and poll()
+ * instead of raw samples. Windows are computed in the driver from every
+ * generated sample and kept in a broadcast queue like the alert events;
+ * a gap in seq means windows were lost. The raw stream and the mmap-ed
+ * ring are not affected.
+ */
+#define SIMTEMP_STREAM_RAW 0
+#define SIMTEMP_STREAM_AGG 1
+
+struct simtemp_agg {
+    __u64 start_ns;      /* Timestamp of the first sample in the window */
+    __u64 end_ns;        /* Timestamp of the last sample in the window */
+    __s32 min_mC;
+    __s32 max_mC;
+    __s32 mean_mC;
+    __u32 count;         /* Samples in the window */
+    __u64 seq;           /* Window sequence number, +1 per window */
+};
+
+/* ================== Configuration ================== */
+
+/* Temperature generator (mode attribute, simtemp_config.mode) */
+enum simtemp_mode {
+    SIMTEMP_MODE_NORMAL,     /* NORMAL_MEAN_MILLIC ± NORMAL_DELTA_MILLIC */
+    SIMTEMP_MODE_NOISY,      /* NOISY_MEAN_MILLIC ± NOISY_DELTA_MILLIC */
+    SIMTEMP_MODE_RAMP,       /* RAMP_START_MILLIC..RAMP_MAX_MILLIC sawtooth */
+    SIMTEMP_MODE_SINE,       /* base ± amplitude sine over period samples */
+    SIMTEMP_MODE_STEP,       /* base / base + amplitude square wave */
+    SIMTEMP_MODE_RC,         /* First-order (tau) response to the step wave */
+    SIMTEMP_MODE_GAUSSIAN,   /* base + N(0, noise) */
+    SIMTEMP_MODE_LUT,        /* User lookup table, one entry per sample */
+    SIMTEMP_MODE_REPLAY,     /* Recorded trace loaded through write() */
+    SIMTEMP_MODE_COUNT,
+};
+
+/* Execution context in which samples are generated (gen_context attribute) */
+enum simtemp_ctx {
+    SIMTEMP_CTX_WORKQUEUE,   /* hrtimer -> shared system workqueue (legacy) */
+    SIMTEMP_CTX_HIGHPRI,     /* hrtimer -> dedicated WQ_HIGHPRI | WQ_UNBOUND queue (system_highpri_wq when pinned) */
+    SIMTEMP_CTX_HRTIMER,     /* generated inside the hrtimer callback (softirq) */
+    SIMTEMP_CTX_COUNT,
+};
+
+/*
+ * Complete sampling configuration, applied as a whole by
+ * SIMTEMP_IOC_SET_CONFIG: the producer is stopped, every field is
+ * validated and switched, and sampling restarts with a fresh timer, so
+ * the device never runs with half of a configuration. Use
+ * SIMTEMP_IOC_GET_CONFIG first and change only the fields of interest.
+ * SET_CONFIG needs a file opened for writing (EBADF otherwise).
+ * Each field has the range of the sysfs attribute of the same name.
+ */
+struct simtemp_config {
+    __u64 period_ns;         /* sampling_ns */
+    __u64 wakeup_timeout_ns;
+    __u64 agg_window_ns;
+    __s32 threshold_mC;
+    __s32 threshold_low_mC;
+    __u32 mode;              /* enum simtemp_mode */
+    __u32 gen_context;       /* enum simtemp_ctx */
+    __s32 cpu;               /* -1 = unpinned */
+    __u32 batch;
+    __u32 wakeup_watermark;
+    __u32 reserved[9];       /* Must be zero */
+};
+
+/*
+ * Binary snapshot of the stats attribute, returned by SIMTEMP_IOC_GET_STATS
+ * and by reading the stats_bin sysfs file (which needs no open device).
+ */
+struct simtemp_stats {
+    __u64 updates;           /* Samples produced */
+    __u64 alerts;
+    __u64 missed;            /* Sample periods skipped by late timer callbacks */
+    __u64 coalesced;
+    __u64 dropped;           /* Samples readers lost to ring overruns */
+    __u64 high_water;        /* Highest ring occupancy seen by a reader */
+    __u64 seq;               /* Sequence number of the next sample */
+    __u64 consumed;          /* Samples returned by read() (mmap consumers not included) */
+    __u64 wakeups;           /* Reader wakeups issued by the producer */
+    __u64 overruns;          /* Timer expiries skipped by late callbacks */
+    __u64 lat_min_ns;        /* Producer latency: timer expiry to batch published */
+    __u64 lat_max_ns;
+    __u32 last_error;
+    __u32 reserved[5];
+};
+
+/* ================== ioctl ================== */
+
+#define SIMTEMP_IOC_MAGIC 'S'
+
+/* Get/set the record layout read() returns on this file (SIMTEMP_ABI_*) */
+#define SIMTEMP_IOC_GET_ABI _IOR(SIMTEMP_IOC_MAGIC, 0, __u32)
+#define SIMTEMP_IOC_SET_ABI _IOW(SIMTEMP_IOC_MAGIC, 1, __u32)
+
+/* Dequeue the next alert event of this file; blocks unless O_NONBLOCK */
+#define SIMTEMP_IOC_GET_EVENT _IOR(SIMTEMP_IOC_MAGIC, 2, struct simtemp_event)
+
+/* Get/set what read() and POLLIN report on this file (SIMTEMP_STREAM_*) */
+#define SIMTEMP_IOC_GET_STREAM _IOR(SIMTEMP_IOC_MAGIC, 3, __u32)
+#define SIMTEMP_IOC_SET_STREAM _IOW(SIMTEMP_IOC_MAGIC, 4, __u32)
+
+/* Device-wide configuration and statistics */
+#define SIMTEMP_IOC_GET_CONFIG _IOR(SIMTEMP_IOC_MAGIC, 5, struct simtemp_config)
+#define SIMTEMP_IOC_SET_CONFIG _IOW(SIMTEMP_IOC_MAGIC, 6, struct simtemp_config)
+#define SIMTEMP_IOC_GET_STATS  _IOR(SIMTEMP_IOC_MAGIC, 7, struct simtemp_stats)
+
+/* ================== Shared Ring (mmap) ================== */
+
+/*
+ * The ring is a broadcast buffer: every open file of the device has its
+ * own read cursor, so several consumers each see every sample.
+ *
+ * mmap() at offset SIMTEMP_MMAP_RING_OFF maps, read-only and shared by
+ * all consumers:
+ *
+ *   [ header page: struct simtemp_ring_hdr ][ nr_samples sample records ]
+ *
+ * Records in the ring always use the current layout (struct
+ * simtemp_sample); consumers must check version and sample_size.
+ *
+ * The sample array starts at data_offset bytes from the start of the
+ * mapping and must be indexed as (counter & (nr_samples - 1)).
+ *
+ * mmap() at offset SIMTEMP_MMAP_CURSOR_OFF maps one writable page private
+ * to the open file: struct simtemp_ring_cursor. Once it is mapped, read()
+ * and poll() on that file use the cursor stored there, so an mmap
+ * consumer only needs to call poll() when it has drained the ring.
+ *
+ * head and tail are free-running 32-bit counters. The driver publishes
+ * head after the sample it covers is written; the consumer owns its tail
+ * and advances it after it has read a record. The producer never waits
+ * for consumers: when head - tail >= nr_samples the oldest records were
+ * overwritten and the consumer must skip ahead to head - nr_samples + 1.
+ *
+ * head must be loaded with acquire semantics before reading records and
+ * loaded again (after a read barrier) once they were copied: if by then
+ * head - start >= nr_samples the producer lapped the consumer during the
+ * copy and the records must be discarded.
+ */
+#define SIMTEMP_RING_MAGIC   0x504d5453  /* "STMP" little-endian */
+#define SIMTEMP_RING_VERSION 3
+
+#define SIMTEMP_MMAP_RING_OFF   0x00000000ULL
+#define SIMTEMP_MMAP_CURSOR_OFF 0x80000000ULL
+
+struct simtemp_ring_hdr {
+    __u32 magic;         /* SIMTEMP_RING_MAGIC */
+    __u32 version;       /* SIMTEMP_RING_VERSION */
+    __u32 nr_samples;    /* Ring capacity in records (power of two) */
+    __u32 sample_size;   /* sizeof(struct simtemp_sample) */
+    __u32 data_offset;   /* Byte offset of record 0 within the mapping */
+    __u32 reserved0[11];
+
+    /* Producer cacheline */
+    __u32 head;          /* Written by the driver (release store) */
+    __u32 reserved1[15];
+};
+
+/* Per-file consumer cursor, at SIMTEMP_MMAP_CURSOR_OFF */
+struct simtemp_ring_cursor {
+    __u32 tail;          /* Written by the consumer */
+    __u32 reserved[15];
+};
+
+#endif /* NXP_SIMTEMP_UAPI_H */
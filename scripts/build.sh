@@ -25,8 +25,15 @@ fi
 
 echo "✅ Kernel module built: $KO_FILE"
 
+echo "🛠️  Building client library..."
+make -C "$USER_DIR/lib"
+
+echo "🛠️  Building benchmark..."
+make -C "$USER_DIR/bench"
+
 echo "🐍 Checking Python dependencies..."
 sudo apt install python3-matplotlib
+sudo apt install python3-numpy
 sudo apt install python3-tk
 
 echo "✅ Build complete!"
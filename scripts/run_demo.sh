@@ -7,8 +7,10 @@ DEVICE="/dev/simtemp"
 SYSFS_DIR="/sys/class/misc/simtemp"
 CLI="$ROOT_DIR/user/cli/main.py"
 
+# Configuration is applied at probe time, before the first sample
 echo "🚀 Inserting module..."
-sudo insmod "$KO_FILE" || { echo "❌ insmod failed"; exit 1; }
+sudo insmod "$KO_FILE" sampling_ns=500000000 threshold_mC=40500 mode=normal \
+    || { echo "❌ insmod failed"; exit 1; }
 sudo chmod 666 /dev/simtemp
 
 sleep 1  # give time for probe()
@@ -19,11 +21,6 @@ if [ ! -e "$DEVICE" ]; then
     exit 1
 fi
 
-echo "⚙️  Configuring parameters..."
-echo 500 | sudo tee "$SYSFS_DIR/sampling_ms" >/dev/null
-echo 40500 | sudo tee "$SYSFS_DIR/threshold_mC" >/dev/null
-sudo python3 "$ROOT_DIR/user/cli/main.py" --mode normal >/dev/null
-
 echo "📋 Current configuration:"
 echo "  sampling_ms:   $(cat "$SYSFS_DIR/sampling_ms")"
 echo "  threshold_mC:  $(cat "$SYSFS_DIR/threshold_mC")"
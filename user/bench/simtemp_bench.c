@@ -0,0 +1,577 @@
+/*
+ * simtemp_bench - throughput and latency benchmark for /dev/simtemp
+ *
+ * Sweeps sampling period, batch size, reader count and read size across
+ * the read(), poll()+read() and mmap consumer paths. Every point of the
+ * sweep is applied atomically with SIMTEMP_IOC_SET_CONFIG, measured for
+ * a fixed time and printed as one JSON object (or CSV row) per line, so
+ * runs against two driver versions can be diffed or plotted directly.
+ *
+ * Per point:
+ *   - produced/s    samples the driver generated (stats updates)
+ *   - consumed/s    samples received per reader
+ *   - drop_rate     samples a reader lost (seq gaps) / samples it should have seen
+ *   - cpu_ns        process CPU time (user + sys) per received sample
+ *   - age p50/p99/p999/max: receive time - sample timestamp (CLOCK_MONOTONIC)
+ *
+ * The original device configuration is restored on exit.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nxp_simtemp_uapi.h"
+
+#define MAX_LIST    16
+#define MAX_READERS 64
+
+/* Age histogram: 32 linear sub-buckets per power of two (< 3% error) */
+#define HIST_SUB    32
+#define HIST_SIZE   (HIST_SUB + 59 * HIST_SUB)
+
+enum path { PATH_READ, PATH_POLL, PATH_MMAP, PATH_COUNT };
+static const char * const path_names[PATH_COUNT] = { "read", "poll", "mmap" };
+
+struct list {
+    unsigned int n;
+    uint64_t v[MAX_LIST];
+};
+
+struct point {
+    enum path path;
+    uint64_t period_ns;
+    uint32_t batch;
+    unsigned int readers;
+    unsigned int read_size;         /* Records per read() / per mmap drain */
+};
+
+struct reader {
+    pthread_t thread;
+    const struct point *pt;
+    int fd;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t last_seq;
+    int have_seq;
+    uint64_t calls;
+    uint64_t hist[HIST_SIZE];
+    uint64_t age_max;
+    int error;
+    atomic_int done;        /* set by the thread as it exits */
+};
+
+static const char *device = "/dev/simtemp";
+static double seconds = 2.0;
+static int csv;
+static atomic_int stop;
+static volatile sig_atomic_t interrupted;
+
+/* ------------------------------------------------------------ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int hist_index(uint64_t v)
+{
+    unsigned int e;
+
+    if (v < HIST_SUB)
+        return v;
+    e = 63 - __builtin_clzll(v);   /* >= 5 */
+    return HIST_SUB + (e - 5) * HIST_SUB + ((v >> (e - 5)) & (HIST_SUB - 1));
+}
+
+static uint64_t hist_value(unsigned int i)
+{
+    unsigned int e;
+
+    if (i < HIST_SUB)
+        return i;
+    e = (i - HIST_SUB) / HIST_SUB + 5;
+    return (uint64_t)(HIST_SUB + (i & (HIST_SUB - 1))) << (e - 5);
+}
+
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total, double p)
+{
+    uint64_t want = (uint64_t)(p * total), sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        sum += hist[i];
+        if (sum > want)
+            return hist_value(i);
+    }
+    return 0;
+}
+
+/* Account one received sample */
+static void account(struct reader *r, const struct simtemp_sample *s, uint64_t now)
+{
+    uint64_t age = now > s->timestamp_ns ? now - s->timestamp_ns : 0;
+
+    if (r->have_seq && s->seq != r->last_seq + 1)
+        r->lost += s->seq - r->last_seq - 1;
+    r->last_seq = s->seq;
+    r->have_seq = 1;
+    r->received++;
+    r->hist[hist_index(age)]++;
+    if (age > r->age_max)
+        r->age_max = age;
+}
+
+static void account_buf(struct reader *r, const struct simtemp_sample *buf, size_t n)
+{
+    uint64_t now = now_ns();
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        account(r, &buf[i], now);
+}
+
+/* ------------------------------------------------------------ */
+
+static int open_reader(struct reader *r)
+{
+    uint32_t abi = SIMTEMP_ABI_V2;
+    int flags = r->pt->path == PATH_MMAP ? O_RDWR :
+                r->pt->path == PATH_POLL ? O_RDONLY | O_NONBLOCK : O_RDONLY;
+
+    r->fd = open(device, flags);
+    if (r->fd < 0)
+        return -errno;
+    if (ioctl(r->fd, SIMTEMP_IOC_SET_ABI, &abi) < 0)
+        return -errno;
+    return 0;
+}
+
+/* Blocking read(): one read_size request per call */
+static void run_read(struct reader *r, struct simtemp_sample *buf)
+{
+    size_t len = r->pt->read_size * sizeof(*buf);
+    ssize_t n;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        n = read(r->fd, buf, len);
+        r->calls++;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            r->error = errno;
+            return;
+        }
+        account_buf(r, buf, n / sizeof(*buf));
+    }
+}
+
+/* poll() for POLLIN, then non-blocking read() until the file is drained */
+static void run_poll(struct reader *r, struct simtemp_sample *buf)
+{
+    size_t len = r->pt->read_size * sizeof(*buf);
+    struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+    ssize_t n;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        if (poll(&pfd, 1, 100) < 0 && errno != EINTR) {
+            r->error = errno;
+            return;
+        }
+        r->calls++;
+        while ((n = read(r->fd, buf, len)) > 0) {
+            r->calls++;
+            account_buf(r, buf, n / sizeof(*buf));
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            r->error = errno;
+            return;
+        }
+    }
+}
+
+/* Consume straight from the shared ring; poll() only once it is drained */
+static void run_mmap(struct reader *r, struct simtemp_sample *buf)
+{
+    struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+    const struct simtemp_ring_hdr *hdr;
+    struct simtemp_ring_cursor *cur;
+    const struct simtemp_sample *ring;
+    size_t ring_len;
+    uint32_t nr, head, tail, start, n, i;
+    long page = sysconf(_SC_PAGESIZE);
+
+    hdr = mmap(NULL, page, PROT_READ, MAP_SHARED, r->fd, SIMTEMP_MMAP_RING_OFF);
+    if (hdr == MAP_FAILED) {
+        r->error = errno;
+        return;
+    }
+    if (hdr->magic != SIMTEMP_RING_MAGIC || hdr->version != SIMTEMP_RING_VERSION ||
+        hdr->sample_size != sizeof(struct simtemp_sample)) {
+        munmap((void *)hdr, page);
+        r->error = EPROTO;
+        return;
+    }
+    nr = hdr->nr_samples;
+    ring_len = hdr->data_offset + (size_t)nr * sizeof(struct simtemp_sample);
+    munmap((void *)hdr, page);
+
+    hdr = mmap(NULL, ring_len, PROT_READ, MAP_SHARED, r->fd, SIMTEMP_MMAP_RING_OFF);
+    if (hdr == MAP_FAILED) {
+        r->error = errno;
+        return;
+    }
+    cur = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, SIMTEMP_MMAP_CURSOR_OFF);
+    if (cur == MAP_FAILED) {
+        r->error = errno;
+        munmap((void *)hdr, ring_len);
+        return;
+    }
+    ring = (const void *)((const char *)hdr + hdr->data_offset);
+    tail = __atomic_load_n(&cur->tail, __ATOMIC_RELAXED);
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (poll(&pfd, 1, 100) < 0 && errno != EINTR) {
+                r->error = errno;
+                break;
+            }
+            r->calls++;
+            continue;
+        }
+
+        /* Skip ahead when lapped, copy, then discard what was overwritten */
+        start = head - tail >= nr ? head - nr + 1 : tail;
+        n = head - start < r->pt->read_size ? head - start : r->pt->read_size;
+        for (i = 0; i < n; i++)
+            buf[i] = ring[(start + i) & (nr - 1)];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr->head, __ATOMIC_RELAXED) - start >= nr) {
+            tail = start;   /* retry from the new oldest sample */
+            continue;
+        }
+        account_buf(r, buf, n);
+        tail = start + n;
+        __atomic_store_n(&cur->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    munmap(cur, page);
+    munmap((void *)hdr, ring_len);
+}
+
+static void *reader_thread(void *arg)
+{
+    struct reader *r = arg;
+    struct simtemp_sample *buf = calloc(r->pt->read_size, sizeof(*buf));
+
+    if (!buf) {
+        r->error = ENOMEM;
+        atomic_store(&r->done, 1);
+        return NULL;
+    }
+    switch (r->pt->path) {
+    case PATH_READ:
+        run_read(r, buf);
+        break;
+    case PATH_POLL:
+        run_poll(r, buf);
+        break;
+    default:
+        run_mmap(r, buf);
+        break;
+    }
+    free(buf);
+    atomic_store(&r->done, 1);
+    return NULL;
+}
+
+/* ------------------------------------------------------------ */
+
+static uint64_t cpu_ns(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static void print_header(void)
+{
+    if (csv)
+        printf("path,period_ns,batch,readers,read_size,seconds,produced_per_s,"
+               "consumed_per_s,drop_rate,calls_per_sample,cpu_ns_per_sample,"
+               "age_p50_ns,age_p99_ns,age_p999_ns,age_max_ns,driver_dropped,errors\n");
+}
+
+static int run_point(int ctl, const struct simtemp_config *base, const struct point *pt)
+{
+    struct simtemp_config cfg = *base;
+    struct simtemp_stats st0, st1;
+    static struct reader readers[MAX_READERS];
+    static uint64_t hist[HIST_SIZE];
+    uint64_t t0, t1, c0, c1, received = 0, lost = 0, calls = 0, age_max = 0;
+    unsigned int i, j, started = 0;
+    int errors = 0;
+    double elapsed;
+
+    cfg.period_ns = pt->period_ns;
+    cfg.batch = pt->batch;
+    if (ioctl(ctl, SIMTEMP_IOC_SET_CONFIG, &cfg) < 0) {
+        fprintf(stderr, "SIMTEMP_IOC_SET_CONFIG (period %llu, batch %u): %s\n",
+                (unsigned long long)pt->period_ns, pt->batch, strerror(errno));
+        return -1;
+    }
+
+    memset(readers, 0, sizeof(readers));
+    memset(hist, 0, sizeof(hist));
+    atomic_store(&stop, 0);
+    for (i = 0; i < pt->readers; i++) {
+        readers[i].pt = pt;
+        if (open_reader(&readers[i]) < 0) {
+            fprintf(stderr, "%s: %s\n", device, strerror(errno));
+            errors++;
+            break;
+        }
+    }
+
+    ioctl(ctl, SIMTEMP_IOC_GET_STATS, &st0);
+    c0 = cpu_ns();
+    t0 = now_ns();
+    if (!errors)
+        for (started = 0; started < pt->readers; started++)
+            if (pthread_create(&readers[started].thread, NULL, reader_thread,
+                               &readers[started]))
+                break;
+
+    while (!interrupted && now_ns() - t0 < (uint64_t)(seconds * 1e9))
+        usleep(10000);
+    /* Readers blocked in read() or poll() return with EINTR. A signal that
+     * lands between a reader's stop check and its next read() is lost, so
+     * keep signalling until every reader has seen the flag and exited. */
+    atomic_store(&stop, 1);
+    for (i = 0; i < started; i++)
+        while (!atomic_load(&readers[i].done)) {
+            pthread_kill(readers[i].thread, SIGUSR1);
+            usleep(1000);
+        }
+    for (i = 0; i < started; i++)
+        pthread_join(readers[i].thread, NULL);
+    t1 = now_ns();
+    c1 = cpu_ns();
+    ioctl(ctl, SIMTEMP_IOC_GET_STATS, &st1);
+
+    for (i = 0; i < pt->readers; i++) {
+        struct reader *r = &readers[i];
+
+        if (r->fd > 0)
+            close(r->fd);
+        received += r->received;
+        lost += r->lost;
+        calls += r->calls;
+        errors += r->error != 0;
+        if (r->error)
+            fprintf(stderr, "reader %u: %s\n", i, strerror(r->error));
+        if (r->age_max > age_max)
+            age_max = r->age_max;
+        for (j = 0; j < HIST_SIZE; j++)
+            hist[j] += r->hist[j];
+    }
+
+    elapsed = (t1 - t0) / 1e9;
+#define PT_FIELDS path_names[pt->path], (unsigned long long)pt->period_ns, pt->batch, \
+                  pt->readers, pt->read_size, elapsed, \
+                  (st1.updates - st0.updates) / elapsed, \
+                  received / elapsed / (pt->readers ? pt->readers : 1), \
+                  received + lost ? (double)lost / (received + lost) : 0.0, \
+                  received ? (double)calls / received : 0.0, \
+                  received ? (double)(c1 - c0) / received : 0.0, \
+                  (unsigned long long)hist_percentile(hist, received, 0.50), \
+                  (unsigned long long)hist_percentile(hist, received, 0.99), \
+                  (unsigned long long)hist_percentile(hist, received, 0.999), \
+                  (unsigned long long)age_max, \
+                  (unsigned long long)(st1.dropped - st0.dropped), errors
+    if (csv)
+        printf("%s,%llu,%u,%u,%u,%.3f,%.1f,%.1f,%.6f,%.4f,%.1f,%llu,%llu,%llu,%llu,%llu,%d\n",
+               PT_FIELDS);
+    else
+        printf("{\"path\":\"%s\",\"period_ns\":%llu,\"batch\":%u,\"readers\":%u,"
+               "\"read_size\":%u,\"seconds\":%.3f,\"produced_per_s\":%.1f,"
+               "\"consumed_per_s\":%.1f,\"drop_rate\":%.6f,\"calls_per_sample\":%.4f,"
+               "\"cpu_ns_per_sample\":%.1f,\"age_p50_ns\":%llu,\"age_p99_ns\":%llu,"
+               "\"age_p999_ns\":%llu,\"age_max_ns\":%llu,\"driver_dropped\":%llu,"
+               "\"errors\":%d}\n", PT_FIELDS);
+#undef PT_FIELDS
+    fflush(stdout);
+    return errors ? -1 : 0;
+}
+
+/* ------------------------------------------------------------ */
+
+static int parse_list(const char *arg, struct list *l)
+{
+    char *copy = strdup(arg), *tok, *save, *end;
+
+    l->n = 0;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (l->n == MAX_LIST)
+            goto bad;
+        l->v[l->n] = strtoull(tok, &end, 0);
+        if (*end || end == tok || !l->v[l->n])
+            goto bad;
+        l->n++;
+    }
+    free(copy);
+    return l->n ? 0 : -1;
+bad:
+    free(copy);
+    return -1;
+}
+
+static int parse_paths(const char *arg, unsigned int *mask)
+{
+    char *copy = strdup(arg), *tok, *save;
+    int p;
+
+    *mask = 0;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        for (p = 0; p < PATH_COUNT && strcmp(tok, path_names[p]); p++)
+            ;
+        if (p == PATH_COUNT) {
+            free(copy);
+            return -1;
+        }
+        *mask |= 1U << p;
+    }
+    free(copy);
+    return *mask ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -d, --device PATH      device node (default /dev/simtemp)\n"
+            "  -t, --seconds S        measurement time per point (default 2)\n"
+            "  -p, --period LIST      sampling periods in ns (default 1000000)\n"
+            "  -b, --batch LIST       samples per timer expiry (default 1)\n"
+            "  -r, --readers LIST     concurrent readers (default 1)\n"
+            "  -s, --read-size LIST   records per read() / mmap drain (default 256)\n"
+            "  -m, --paths LIST       read,poll,mmap (default all)\n"
+            "  -c, --csv              CSV instead of JSON lines\n"
+            "LIST is comma separated, e.g. -p 1000000,100000,10000\n", prog);
+}
+
+static void on_signal(int sig)
+{
+    if (sig != SIGUSR1)
+        interrupted = 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option opts[] = {
+        { "device",    required_argument, NULL, 'd' },
+        { "seconds",   required_argument, NULL, 't' },
+        { "period",    required_argument, NULL, 'p' },
+        { "batch",     required_argument, NULL, 'b' },
+        { "readers",   required_argument, NULL, 'r' },
+        { "read-size", required_argument, NULL, 's' },
+        { "paths",     required_argument, NULL, 'm' },
+        { "csv",       no_argument,       NULL, 'c' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    struct list periods = { 1, { 1000000 } }, batches = { 1, { 1 } };
+    struct list readers = { 1, { 1 } }, sizes = { 1, { 256 } };
+    unsigned int paths = (1U << PATH_COUNT) - 1;
+    struct simtemp_config orig;
+    struct sigaction sa;
+    unsigned int ip, ib, ir, is;
+    int path, opt, ctl, ret = 0;
+    struct point pt;
+
+    while ((opt = getopt_long(argc, argv, "d:t:p:b:r:s:m:ch", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 't': seconds = atof(optarg); break;
+        case 'p': ret = parse_list(optarg, &periods); break;
+        case 'b': ret = parse_list(optarg, &batches); break;
+        case 'r': ret = parse_list(optarg, &readers); break;
+        case 's': ret = parse_list(optarg, &sizes); break;
+        case 'm': ret = parse_paths(optarg, &paths); break;
+        case 'c': csv = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+        if (ret) {
+            fprintf(stderr, "invalid argument for -%c: %s\n", opt, optarg);
+            return 2;
+        }
+    }
+    for (ir = 0; ir < readers.n; ir++)
+        if (readers.v[ir] > MAX_READERS) {
+            fprintf(stderr, "at most %d readers\n", MAX_READERS);
+            return 2;
+        }
+    if (seconds <= 0) {
+        fprintf(stderr, "invalid --seconds\n");
+        return 2;
+    }
+
+    /* Control file: applies each point and restores the original config
+     * (SIMTEMP_IOC_SET_CONFIG needs it open for writing) */
+    ctl = open(device, O_RDWR | O_NONBLOCK);
+    if (ctl < 0 || ioctl(ctl, SIMTEMP_IOC_GET_CONFIG, &orig) < 0) {
+        fprintf(stderr, "%s: %s\n", device, strerror(errno));
+        return 1;
+    }
+    /* No SA_RESTART: a signal must interrupt a reader blocked in read() */
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    print_header();
+    for (path = 0; path < PATH_COUNT; path++) {
+        if (!(paths & (1U << path)))
+            continue;
+        for (ip = 0; ip < periods.n; ip++)
+            for (ib = 0; ib < batches.n; ib++)
+                for (ir = 0; ir < readers.n; ir++)
+                    for (is = 0; is < sizes.n && !interrupted; is++) {
+                        pt.path = path;
+                        pt.period_ns = periods.v[ip];
+                        pt.batch = batches.v[ib];
+                        pt.readers = readers.v[ir];
+                        pt.read_size = sizes.v[is];
+                        if (run_point(ctl, &orig, &pt))
+                            ret = 1;
+                    }
+    }
+
+    if (ioctl(ctl, SIMTEMP_IOC_SET_CONFIG, &orig) < 0)
+        fprintf(stderr, "failed to restore the device configuration: %s\n", strerror(errno));
+    close(ctl);
+    return ret;
+}
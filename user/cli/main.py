@@ -1,6 +1,9 @@
 #!/usr/bin/env python3
 import os
 import sys
+import glob
+import mmap
+import fcntl
 import select
 import struct
 import time
@@ -19,18 +22,79 @@ from zoneinfo import ZoneInfo
 # - Monitors live temperature samples
 # - Runs an automated test mode
 # - Prints device statistics
+# - Records the sample stream to binary files
 # ==========================================
 
 DEVICE = "/dev/simtemp"
 SYSFS_BASE = "/sys/class/misc/simtemp"
 
-# Binary structure of one temperature sample
+# Native decoding through libsimtemp (user/lib) once it has been built
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lib"))
+try:
+    import simtemp as libsimtemp
+    if not libsimtemp.available():
+        libsimtemp = None
+except ImportError:
+    libsimtemp = None
+import simtemp_record
+
+
+def select_device(path):
+    """Point the CLI at another instance, e.g. /dev/simtemp3."""
+    global DEVICE, SYSFS_BASE
+    DEVICE = path
+    SYSFS_BASE = os.path.join("/sys/class/misc", os.path.basename(path))
+
+# Binary structure of one temperature sample (ABI v2, struct simtemp_sample)
 # Q: 8-byte unsigned long long (timestamp_ns)
 # i: 4-byte int (temp_mC)
-# i: 4-byte int (flags)
-record_fmt = "Qii"
+# I: 4-byte unsigned int (flags: 0x1 new, 0x2 alert, 0x4 samples dropped before this one,
+#    0x8 first sample after a restart / period change)
+# Q: 8-byte unsigned long long (seq)
+record_fmt = "=QiIQ"
 record_size = struct.calcsize(record_fmt)
 
+# Every open file starts with the legacy 16-byte layout; opt into v2
+SIMTEMP_ABI_V2 = 2
+SIMTEMP_IOC_SET_ABI = 0x40045301   # _IOW('S', 1, __u32)
+
+# struct simtemp_event: timestamp_ns, temp_mC, type, seq, lost, reserved
+event_fmt = "=QiIQII"
+event_size = struct.calcsize(event_fmt)
+SIMTEMP_IOC_GET_EVENT = 0x80205302  # _IOR('S', 2, struct simtemp_event)
+EVENT_NAMES = {1: "RISING", 2: "FALLING"}
+
+# struct simtemp_agg: start_ns, end_ns, min_mC, max_mC, mean_mC, count, seq
+agg_fmt = "=QQiiiIQ"
+agg_size = struct.calcsize(agg_fmt)
+SIMTEMP_STREAM_AGG = 1
+SIMTEMP_IOC_SET_STREAM = 0x40045304  # _IOW('S', 4, __u32)
+
+# struct simtemp_config / struct simtemp_stats (binary control interface)
+config_fmt = "=QQQiiIIiII9I"
+config_fields = ("period_ns", "wakeup_timeout_ns", "agg_window_ns", "threshold_mC",
+                 "threshold_low_mC", "mode", "gen_context", "cpu", "batch", "wakeup_watermark")
+SIMTEMP_IOC_GET_CONFIG = 0x80585305  # _IOR('S', 5, struct simtemp_config)
+SIMTEMP_IOC_SET_CONFIG = 0x40585306  # _IOW('S', 6, struct simtemp_config)
+SIMTEMP_MODE_NOISY = 1
+
+# Number of samples requested per read(); the driver returns as many
+# whole samples as are queued, up to the buffer size.
+READ_BATCH = 256
+
+# Batches taken from one ready device before the monitor serves the others
+MONITOR_BATCHES = 16
+
+# The test waits this many sampling periods (at least TEST_TIMEOUT_MIN s) for an alert
+TEST_TIMEOUT_PERIODS = 20
+TEST_TIMEOUT_MIN = 5.0
+
+# Shared ring header (struct simtemp_ring_hdr in kernel/nxp_simtemp_uapi.h)
+RING_MAGIC = 0x504d5453
+RING_HDR_FMT = "IIIII"      # magic, version, nr_samples, sample_size, data_offset
+RING_HEAD_OFFSET = 64
+MMAP_CURSOR_OFF = 0x80000000  # per-file struct simtemp_ring_cursor page
+
 # Set timezone to Guadalajara
 GDL_TZ = ZoneInfo("America/Mexico_City")
 
@@ -71,7 +135,7 @@ def print_stats():
 
 
 def set_mode(mode):
-    """Set the sensor mode (normal, noisy, ramp)."""
+    """Set the sensor mode (normal, noisy, ramp, sine, step, rc, gaussian, lut)."""
     mode_path = os.path.join(SYSFS_BASE, "mode")
     print(f"Setting mode to '{mode}'...")
     if write_sysfs(mode_path, mode):
@@ -80,6 +144,28 @@ def set_mode(mode):
         print("Failed to set mode.")
 
 
+def set_waveform(params):
+    """Update waveform parameters, e.g. "amplitude_mC=2000 period=500"."""
+    path = os.path.join(SYSFS_BASE, "waveform")
+    print(f"Setting waveform parameters '{params}'...")
+    if write_sysfs(path, params):
+        print(f"Waveform: {read_sysfs(path)}")
+    else:
+        print("Failed to set waveform parameters.")
+
+
+def load_lut(filename):
+    """Upload a lookup table (one temperature in m°C per line) for the lut mode."""
+    with open(filename) as f:
+        values = [int(line) for line in f if line.strip()]
+    print(f"Uploading {len(values)} LUT entries...")
+    try:
+        with open(os.path.join(SYSFS_BASE, "lut"), "wb") as f:
+            f.write(struct.pack(f"={len(values)}i", *values))
+    except OSError as e:
+        print(f"Error writing LUT: {e}")
+
+
 def set_threshold(value):
     """Configure the alert threshold (in milli°C)."""
     path = os.path.join(SYSFS_BASE, "threshold_mC")
@@ -99,38 +185,374 @@ def set_sampling(value):
     else:
         print("Failed to set sampling interval.")
 
+
+def set_sampling_ns(value):
+    """Configure the sampling interval in nanoseconds (sub-millisecond rates)."""
+    path = os.path.join(SYSFS_BASE, "sampling_ns")
+    print(f"Setting sampling interval to {value} ns...")
+    if write_sysfs(path, value):
+        print(f"Sampling interval set to: {read_sysfs(path)} ns")
+    else:
+        print("Failed to set sampling interval.")
+
 # ------------------------------------------
-# Live monitoring mode
+# Device access
 # ------------------------------------------
-def live_poll():
+def open_device(flags, path=None):
+    """Open the sample device (DEVICE by default) and switch it to the v2 record layout."""
+    fd = os.open(path or DEVICE, flags)
+    try:
+        fcntl.ioctl(fd, SIMTEMP_IOC_SET_ABI, struct.pack("I", SIMTEMP_ABI_V2))
+    except OSError:
+        os.close(fd)
+        raise
+    return fd
+
+def get_config(fd):
+    """Read the device configuration as a dict (SIMTEMP_IOC_GET_CONFIG)."""
+    buf = bytearray(struct.calcsize(config_fmt))
+    fcntl.ioctl(fd, SIMTEMP_IOC_GET_CONFIG, buf, True)
+    return dict(zip(config_fields, struct.unpack(config_fmt, buf)))
+
+
+def set_config(fd, cfg):
+    """Apply a complete configuration in one step (SIMTEMP_IOC_SET_CONFIG)."""
+    values = [cfg[k] for k in config_fields] + [0] * 9
+    fcntl.ioctl(fd, SIMTEMP_IOC_SET_CONFIG, struct.pack(config_fmt, *values))
+
+
+def load_replay(filename, speed):
+    """Load a trace (raw v2 records or a --record file) for the replay mode and select it."""
+    if simtemp_record.is_recording(filename):
+        data = b"".join(simtemp_record.to_records(c) for c in simtemp_record.read_chunks(filename))
+    else:
+        with open(filename, "rb") as f:
+            data = f.read()
+    if len(data) % record_size:
+        print(f"{filename}: size is not a multiple of {record_size} bytes")
+        return False
+    write_sysfs(os.path.join(SYSFS_BASE, "replay_speed"), speed)
+    fd = open_device(os.O_WRONLY)
+    try:
+        view = memoryview(data)
+        while view:
+            view = view[os.write(fd, view):]
+    finally:
+        os.close(fd)  # the trace is handed to the driver on close
+    print(f"Loaded {len(data) // record_size} records, replaying at {speed}x")
+    return write_sysfs(os.path.join(SYSFS_BASE, "mode"), "replay")
+
+# ------------------------------------------
+# Shared ring (mmap) reader
+# ------------------------------------------
+class MmapRing:
     """
-    Continuously poll the /dev/simtemp device for new samples.
-    Uses non-blocking I/O and poll() to react to incoming data.
+    Zero-copy consumer of the ring exported by mmap() on /dev/simtemp.
+    Samples are read straight from the read-only ring mapping; the
+    consumer advances its own cursor in the per-file cursor page, so
+    no read() syscalls are needed.
     """
-    fd = os.open(DEVICE, os.O_RDONLY | os.O_NONBLOCK)
-    poller = select.poll()
-    poller.register(fd, select.POLLIN | select.POLLPRI)
 
-    print(f"Polling {DEVICE} for new temperature samples...\n")
+    def __init__(self, fd):
+        hdr = mmap.mmap(fd, mmap.PAGESIZE, mmap.MAP_SHARED, mmap.PROT_READ)
+        magic, _, self.nr_samples, self.sample_size, self.data_offset = \
+            struct.unpack_from(RING_HDR_FMT, hdr, 0)
+        hdr.close()
+        if magic != RING_MAGIC or self.sample_size != record_size:
+            raise OSError("unsupported simtemp ring layout")
+
+        length = self.data_offset + self.nr_samples * self.sample_size
+        self.map = mmap.mmap(fd, length, mmap.MAP_SHARED, mmap.PROT_READ)
+        self.cursor = mmap.mmap(fd, mmap.PAGESIZE, mmap.MAP_SHARED,
+                                mmap.PROT_READ | mmap.PROT_WRITE,
+                                offset=MMAP_CURSOR_OFF)
+
+    def drain(self, limit=READ_BATCH):
+        """Return up to limit raw records and advance the shared tail."""
+        while True:
+            head, = struct.unpack_from("I", self.map, RING_HEAD_OFFSET)
+            tail, = struct.unpack_from("I", self.cursor, 0)
+            if (head - tail) & 0xffffffff >= self.nr_samples:
+                tail = (head - self.nr_samples + 1) & 0xffffffff   # overwritten, skip ahead
+            n = min((head - tail) & 0xffffffff, limit)
+
+            out = bytearray()
+            pos = tail
+            while n:
+                idx = pos % self.nr_samples
+                span = min(n, self.nr_samples - idx)
+                off = self.data_offset + idx * self.sample_size
+                out += self.map[off:off + span * self.sample_size]
+                pos = (pos + span) & 0xffffffff
+                n -= span
+
+            # Discard the copy if the producer lapped us while copying
+            head, = struct.unpack_from("I", self.map, RING_HEAD_OFFSET)
+            if (head - tail) & 0xffffffff < self.nr_samples:
+                break
+
+        struct.pack_into("I", self.cursor, 0, pos)
+        return bytes(out)
+
+    def close(self):
+        self.cursor.close()
+        self.map.close()
+
+class SampleSource:
+    """
+    Batches of samples from a device (DEVICE by default) as columns
+    (timestamp_ns, temp_mC, flags, seq). With libsimtemp the records are
+    decoded in C; without it they are read with os.read() or MmapRing and
+    unpacked here. writable opens the device read-write, as set_config() needs.
+    """
+
+    def __init__(self, use_mmap=False, nonblock=True, max_batch=READ_BATCH, path=None,
+                 writable=False):
+        self.dev = self.ring = None
+        self.max_batch = max_batch
+        self.path = path or DEVICE
+        if libsimtemp:
+            self.dev = libsimtemp.Device(self.path, nonblock=nonblock, use_mmap=use_mmap,
+                                         max_batch=max_batch, writable=writable)
+            self.fd = self.dev.fileno()
+        else:
+            flags = (os.O_RDWR if use_mmap or writable else os.O_RDONLY) | \
+                (os.O_NONBLOCK if nonblock else 0)
+            self.fd = open_device(flags, self.path)
+            self.ring = MmapRing(self.fd) if use_mmap else None
+
+    def fileno(self):
+        return self.fd
+
+    def read(self):
+        """Return the next batch; empty columns when nothing is pending."""
+        if self.dev:
+            batch = self.dev.read_columns()
+            return batch.timestamp_ns, batch.temp_mC, batch.flags, batch.seq
+        if self.ring:
+            data = self.ring.drain(limit=self.max_batch)
+        else:
+            try:
+                data = os.read(self.fd, record_size * self.max_batch)
+            except BlockingIOError:
+                data = b""
+        rows = list(struct.iter_unpack(record_fmt, data[:len(data) - len(data) % record_size]))
+        return tuple(zip(*rows)) if rows else ((), (), (), ())
+
+    def close(self):
+        if self.dev:
+            self.dev.close()
+            return
+        if self.ring:
+            self.ring.close()
+        os.close(self.fd)
+
+# ------------------------------------------
+# Live monitoring mode
+# ------------------------------------------
+def print_samples(batch, last_seq=None, label=""):
+    """
+    Print every sample of a SampleSource batch, prefixed with label.
+    Gaps in the sequence numbers are reported with the exact number of
+    samples lost. Returns the sequence number of the last record printed.
+    """
+    now = datetime.now(GDL_TZ)
+    for ts_ns, temp, flags, seq in zip(*batch):
+        if last_seq is not None and seq != last_seq + 1:
+            print(f"{label}--- {seq - last_seq - 1} samples dropped (reader overrun) ---")
+        last_seq = seq
+        if flags & 0x8:
+            print(f"{label}--- sampling restarted (new configuration) ---")
+        alert = "YES" if flags & 0x2 else "NO"
+        print(f"{label}{now.strftime('%Y-%m-%d %H:%M:%S')} | {temp/1000:.2f} °C | Threshold crossed? {alert}")
+    return last_seq
+
+
+def drain_events(fd, label=""):
+    """Print every alert event (hysteresis edge) pending on a non-blocking fd."""
+    while True:
+        buf = bytearray(event_size)
+        try:
+            fcntl.ioctl(fd, SIMTEMP_IOC_GET_EVENT, buf, True)
+        except BlockingIOError:
+            return
+        _, temp, etype, seq, lost, _ = struct.unpack(event_fmt, buf)
+        if lost:
+            print(f"{label}--- {lost} alert events lost ---")
+        print(f"{label}*** ALERT {EVENT_NAMES.get(etype, etype)} at seq {seq}: {temp/1000:.2f} °C ***")
+
+
+def live_poll(paths, use_mmap=False):
+    """
+    Monitor one or many sensor nodes from a single thread. Every device
+    is registered with one epoll instance for EPOLLIN (samples) and
+    EPOLLPRI (alert edge); the loop sleeps in epoll_wait() without a
+    timeout and only touches the devices that are ready. Level-triggered
+    readiness lets a busy device be served a few batches at a time
+    without starving the others.
+    """
+    ep = select.epoll()
+    watched = {}   # fd -> [label, source, last_seq]
+    try:
+        for path in paths:
+            source = SampleSource(use_mmap, path=path)
+            label = f"{os.path.basename(path)}: " if len(paths) > 1 else ""
+            ep.register(source.fileno(), select.EPOLLIN | select.EPOLLPRI)
+            watched[source.fileno()] = [label, source, None]
+
+        print(f"Polling {', '.join(paths)} for new temperature samples...\n")
+        while watched:
+            for fd, mask in ep.poll():
+                label, source, last_seq = watched[fd]
+                if mask & select.EPOLLPRI:
+                    drain_events(fd, label)
+                if mask & select.EPOLLIN:
+                    for _ in range(MONITOR_BATCHES):
+                        batch = source.read()
+                        if not batch[0]:
+                            break
+                        last_seq = print_samples(batch, last_seq, label)
+                    watched[fd][2] = last_seq
+                if mask & (select.EPOLLERR | select.EPOLLHUP):
+                    print(f"{label}--- device gone ---")
+                    ep.unregister(fd)
+                    source.close()
+                    del watched[fd]
+    except KeyboardInterrupt:
+        print("\nExiting...")
+    finally:
+        for _, source, _ in watched.values():
+            source.close()
+        ep.close()
+
+def live_agg():
+    """Print the driver's aggregated windows (min/max/mean per agg_window_ns)."""
+    fd = open_device(os.O_RDONLY)
+    fcntl.ioctl(fd, SIMTEMP_IOC_SET_STREAM, struct.pack("I", SIMTEMP_STREAM_AGG))
+    window = read_sysfs(os.path.join(SYSFS_BASE, "agg_window_ns"))
+    print(f"Aggregated windows from {DEVICE} (agg_window_ns={window})...\n")
+    last_seq = None
 
     try:
         while True:
-            # Wait up to 1s for new data
-            events = poller.poll(1000)
-            for fd_, flag in events:
-                if flag & (select.POLLIN | select.POLLPRI):
-                    data = os.read(fd, record_size)
-                    if len(data) != record_size:
-                        continue
-                    ts_ns, temp, flags = struct.unpack(record_fmt, data)
-                    alert = "YES" if flags & 0x2 else "NO"
-                    now = datetime.now(GDL_TZ)
-                    print(f"{now.strftime('%Y-%m-%d %H:%M:%S')} | {temp/1000:.2f} °C | Threshold crossed? {alert}")
+            data = os.read(fd, agg_size * 64)  # blocks until a window closes
+            for start, end, tmin, tmax, tmean, count, seq in struct.iter_unpack(agg_fmt, data):
+                if last_seq is not None and seq != last_seq + 1:
+                    print(f"--- {seq - last_seq - 1} windows lost ---")
+                last_seq = seq
+                print(f"window {seq}: {count} samples over {(end - start) / 1e6:.1f} ms | "
+                      f"min {tmin/1000:.2f} °C  max {tmax/1000:.2f} °C  mean {tmean/1000:.2f} °C")
     except KeyboardInterrupt:
         print("\nExiting...")
     finally:
         os.close(fd)
 
+# ------------------------------------------
+# Binary recording
+# ------------------------------------------
+def run_record(filename, seconds=None, use_mmap=False, codec="zlib", rotate_mb=0):
+    """
+    Drain the device in large batches into a simtemp_record file until
+    Ctrl+C or for seconds. Samples keep the driver's timestamp_ns; nothing
+    is formatted per sample, and compression and disk writes run on the
+    recorder's own thread.
+    """
+    source = SampleSource(use_mmap, max_batch=1 << 16)
+    poller = select.poll()
+    poller.register(source.fileno(), select.POLLIN)
+    rec = simtemp_record.Recorder(filename, codec=codec, rotate_bytes=rotate_mb << 20)
+
+    print(f"Recording {DEVICE} to {filename} (Ctrl+C to stop)...")
+    start = time.monotonic()
+    first_seq = last_seq = None
+    try:
+        while seconds is None or time.monotonic() - start < seconds:
+            ts, temp, flags, seq = source.read()
+            if not seq:
+                poller.poll(100)
+                continue
+            rec.write(ts, temp, flags, seq)
+            if first_seq is None:
+                first_seq = seq[0]
+            last_seq = seq[-1]
+    except KeyboardInterrupt:
+        pass
+    finally:
+        source.close()
+        rec.close()
+
+    elapsed = time.monotonic() - start
+    lost = last_seq - first_seq + 1 - rec.samples if rec.samples else 0
+    print(f"samples={rec.samples} lost={lost} seconds={elapsed:.2f} "
+          f"samples_per_s={rec.samples / elapsed:.0f} bytes={rec.bytes_written} "
+          f"bytes_per_sample={rec.bytes_written / max(rec.samples, 1):.2f}")
+    print("files: " + " ".join(rec.files))
+
+
+def dump_recording(filenames):
+    """Print recordings as CSV (seq,timestamp_ns,temp_mC,flags); summary to stderr."""
+    out = sys.stdout
+    out.write("seq,timestamp_ns,temp_mC,flags\n")
+    samples = gaps = 0
+    last_seq = None
+    for name in filenames:
+        for chunk in simtemp_record.read_chunks(name):
+            out.writelines(f"{q},{t},{c},{f}\n" for t, c, f, q in zip(*chunk))
+            if last_seq is not None:
+                gaps += chunk.seq[0] - last_seq - 1
+            gaps += chunk.seq[-1] - chunk.seq[0] + 1 - len(chunk.seq)
+            last_seq = chunk.seq[-1]
+            samples += len(chunk.seq)
+    print(f"{samples} samples, {gaps} missing by seq", file=sys.stderr)
+
+
+# ------------------------------------------
+# Consumer throughput benchmark
+# ------------------------------------------
+def read_stats():
+    """Return the stats attribute as a dict of integer counters."""
+    stats = read_sysfs(os.path.join(SYSFS_BASE, "stats")) or ""
+    return {k: int(v) for k, v in (f.split("=") for f in stats.split() if "=" in f)}
+
+
+def run_bench(seconds, use_mmap=False):
+    """
+    Drain the device as fast as possible for the given number of seconds
+    and report consumer throughput. Samples the driver produced but the
+    consumer never saw (ring overruns) are reported as lost.
+    """
+    source = SampleSource(use_mmap, max_batch=1 << 16)
+    poller = select.poll()
+    poller.register(source.fileno(), select.POLLIN)
+
+    before = read_stats()
+    cpu0 = os.times()
+    start = time.monotonic()
+    samples = calls = 0
+
+    try:
+        while time.monotonic() - start < seconds:
+            n = len(source.read()[0])
+            calls += 1
+            if n:
+                samples += n
+            else:
+                poller.poll(100)
+    finally:
+        elapsed = time.monotonic() - start
+        cpu1 = os.times()
+        after = read_stats()
+        source.close()
+
+    produced = after.get("updates", 0) - before.get("updates", 0)
+    cpu = (cpu1.user - cpu0.user) + (cpu1.system - cpu0.system)
+    print(f"path={'mmap' if use_mmap else 'read'} native={'yes' if libsimtemp else 'no'} "
+          f"seconds={elapsed:.2f} "
+          f"samples={samples} rate={samples / elapsed:.0f}/s "
+          f"calls={calls} per_call={samples / max(calls, 1):.1f} "
+          f"produced={produced} lost={max(produced - samples, 0)} "
+          f"cpu_us_per_sample={cpu * 1e6 / max(samples, 1):.2f}")
+
 # ------------------------------------------
 # Automated device test mode
 # ------------------------------------------
@@ -143,57 +565,55 @@ def run_test():
     """
     print("🚀 Running device test mode...")
 
-    # Backup original parameters
-    orig_mode = read_sysfs(os.path.join(SYSFS_BASE, "mode"))
-    orig_threshold = read_sysfs(os.path.join(SYSFS_BASE, "threshold_mC"))
-    orig_sampling = read_sysfs(os.path.join(SYSFS_BASE, "sampling_ms"))
+    # Non-blocking so a wakeup drains every pending sample; the waiting
+    # itself happens in epoll_wait() with the exact time left; writable
+    # for SIMTEMP_IOC_SET_CONFIG
+    source = SampleSource(writable=True)
+    fd = source.fileno()
 
-    # Apply temporary test configuration
+    # Backup original parameters and apply the test configuration atomically
+    orig_cfg = get_config(fd)
     test_mode = "noisy"
     test_threshold = 39000
     test_sampling = 500
 
-    write_sysfs(os.path.join(SYSFS_BASE, "mode"), test_mode)
-    write_sysfs(os.path.join(SYSFS_BASE, "threshold_mC"), test_threshold)
-    write_sysfs(os.path.join(SYSFS_BASE, "sampling_ms"), test_sampling)
+    test_cfg = dict(orig_cfg, mode=SIMTEMP_MODE_NOISY, threshold_mC=test_threshold,
+                    threshold_low_mC=test_threshold, period_ns=test_sampling * 1000000)
+    set_config(fd, test_cfg)
 
     print(f"Mode={test_mode}, Threshold={test_threshold}, Sampling={test_sampling} ms")
     print("Waiting for a sample to cross threshold...")
 
-    # Open device in non-blocking mode
-    fd = os.open(DEVICE, os.O_RDONLY | os.O_NONBLOCK)
-    poller = select.poll()
-    poller.register(fd, select.POLLIN | select.POLLPRI)
+    ep = select.epoll()
+    ep.register(fd, select.EPOLLIN)
 
-    timeout = 2 * (test_sampling / 1000.0)  # two sampling periods
-    start = time.time()
+    timeout = max(TEST_TIMEOUT_PERIODS * test_sampling / 1000.0, TEST_TIMEOUT_MIN)
+    deadline = time.monotonic() + timeout
     success = False
 
     # Wait for a sample with alert flag
-    while time.time() - start < timeout:
-        events = poller.poll(1000)
-        for fd_, flag in events:
-            if flag & (select.POLLIN | select.POLLPRI):
-                data = os.read(fd, record_size)
-                if len(data) != record_size:
-                    continue
-                _, temp, flags = struct.unpack(record_fmt, data)
-                if flags & 0x2:
+    try:
+        while not success:
+            _, temps, flags, _ = source.read()
+            for temp, flag in zip(temps, flags):
+                if flag & 0x2:
                     print(f"PASS: Sample crossed threshold! Temp={temp/1000:.2f} °C")
                     success = True
                     break
-        if success:
-            break
+            remaining = deadline - time.monotonic()
+            if success or remaining <= 0:
+                break
+            if not temps:
+                ep.poll(remaining)
+    finally:
+        ep.close()
 
     if not success:
-        print("FAIL: No sample crossed threshold in time.")
-
-    os.close(fd)
+        print(f"FAIL: No sample crossed threshold within {timeout:.1f} s.")
 
     # Restore original configuration
-    write_sysfs(os.path.join(SYSFS_BASE, "mode"), orig_mode)
-    write_sysfs(os.path.join(SYSFS_BASE, "threshold_mC"), orig_threshold)
-    write_sysfs(os.path.join(SYSFS_BASE, "sampling_ms"), orig_sampling)
+    set_config(fd, orig_cfg)
+    source.close()
 
 # ------------------------------------------
 # Main CLI entry point
@@ -201,21 +621,66 @@ def run_test():
 def main():
     """Command-line interface argument parser and dispatcher."""
     parser = argparse.ArgumentParser(description="CLI for nxp_simtemp device")
-    parser.add_argument("--mode", help="Set device mode (normal, noisy, ramp)")
+    parser.add_argument("--device", action="append", metavar="DEVICE",
+                        help="Sensor node to use (default /dev/simtemp, or /dev/simtempN); "
+                             "repeat to monitor several, other commands use the first")
+    parser.add_argument("--all", action="store_true",
+                        help="Monitor every /dev/simtemp* node from one thread")
+    parser.add_argument("--mode", help="Set device mode (normal, noisy, ramp, sine, step, rc, gaussian, lut, replay)")
+    parser.add_argument("--waveform", metavar="PARAMS",
+                        help='Waveform parameters, e.g. "amplitude_mC=2000 period=500 noise_mC=100"')
+    parser.add_argument("--lut", metavar="FILE",
+                        help="Upload a lookup table (one m°C value per line) for the lut mode")
+    parser.add_argument("--replay", metavar="FILE",
+                        help="Replay a trace (raw v2 records or a --record file) through the device")
+    parser.add_argument("--replay-speed", type=int, default=1, metavar="N",
+                        help="Replay N times faster than recorded (0 = as fast as possible)")
     parser.add_argument("--stats", action="store_true", help="Show stats and exit")
     parser.add_argument("--threshold", type=int, help="Set threshold in m°C")
     parser.add_argument("--sampling", type=int, help="Set sampling interval in ms")
+    parser.add_argument("--sampling-ns", type=int, help="Set sampling interval in ns")
     parser.add_argument("--test", action="store_true", help="Run automated device test")
+    parser.add_argument("--mmap", action="store_true",
+                        help="Consume samples from the mmap-ed ring instead of read()")
+    parser.add_argument("--agg", action="store_true",
+                        help="Live view of the driver's min/max/mean windows instead of raw samples")
+    parser.add_argument("--bench", type=float, metavar="SECONDS",
+                        help="Measure consumer throughput for SECONDS and exit")
+    parser.add_argument("--record", metavar="FILE",
+                        help="Record samples to a binary file until Ctrl+C (see --duration)")
+    parser.add_argument("--duration", type=float, metavar="SECONDS",
+                        help="Stop --record after SECONDS")
+    parser.add_argument("--compress", choices=sorted(simtemp_record.CODECS), default="zlib",
+                        help="Chunk compression for --record (default zlib)")
+    parser.add_argument("--rotate-mb", type=int, default=0, metavar="N",
+                        help="Start a new --record file (FILE.NNNN) every N MiB")
+    parser.add_argument("--dump", metavar="FILE", nargs="+",
+                        help="Print recordings as CSV and exit")
 
     args = parser.parse_args()
+    if args.dump:
+        dump_recording(args.dump)
+        return
+    devices = args.device or [DEVICE]
+    if args.all:
+        devices = sorted(glob.glob("/dev/simtemp*"), key=lambda p: (len(p), p)) or devices
+    select_device(devices[0])
 
     # Apply configuration options
+    if args.waveform:
+        set_waveform(args.waveform)
+    if args.lut:
+        load_lut(args.lut)
+    if args.replay:
+        load_replay(args.replay, args.replay_speed)
     if args.mode:
         set_mode(args.mode)
     if args.threshold is not None:
         set_threshold(args.threshold)
     if args.sampling is not None:
         set_sampling(args.sampling)
+    if args.sampling_ns is not None:
+        set_sampling_ns(args.sampling_ns)
 
     # Run requested mode
     if args.stats:
@@ -225,9 +690,22 @@ def main():
     if args.test:
         run_test()
         return
+
+    if args.bench:
+        run_bench(args.bench, use_mmap=args.mmap)
+        return
     
+    if args.record:
+        run_record(args.record, args.duration, use_mmap=args.mmap,
+                   codec=args.compress, rotate_mb=args.rotate_mb)
+        return
+
+    if args.agg:
+        live_agg()
+        return
+
     # Default: live monitoring
-    live_poll()
+    live_poll(devices, use_mmap=args.mmap)
 
 
 if __name__ == "__main__":
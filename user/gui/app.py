@@ -1,30 +1,140 @@
 #!/usr/bin/env python3
 import os
+import sys
+import fcntl
 import struct
 import select
 import time
 import threading
 import tkinter as tk
 from tkinter import ttk, messagebox
+import numpy as np
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
 from matplotlib.figure import Figure
 
-DEVICE = "/dev/simtemp"
-SYSFS_BASE = "/sys/class/misc/simtemp"
-record_fmt = "Qii"  # timestamp_ns, temp_mC, flags
+# Optional argument: sensor node, e.g. /dev/simtemp3 (multi-instance driver)
+DEVICE = sys.argv[1] if len(sys.argv) > 1 else "/dev/simtemp"
+SYSFS_BASE = os.path.join("/sys/class/misc", os.path.basename(DEVICE))
+record_fmt = "=QiIQ"  # timestamp_ns, temp_mC, flags, seq (ABI v2)
 record_size = struct.calcsize(record_fmt)
-
-MAX_POINTS = 50 
+SIMTEMP_ABI_V2 = 2
+SIMTEMP_IOC_SET_ABI = 0x40045301  # _IOW('S', 1, __u32)
+
+SAMPLE_DTYPE = np.dtype([("timestamp_ns", "<u8"), ("temp_mC", "<i4"),
+                         ("flags", "<u4"), ("seq", "<u8")])  # record_fmt as numpy
+
+HISTORY = 1 << 17      # Samples kept by the GUI ring
+VIEW_SAMPLES = 10000   # Most recent samples shown in the plot
+READ_BATCH = 4096      # Records taken per read
+FRAME_MS = 33          # Redraw at most ~30 times per second
+
+# Modes accepted by the mode attribute (simtemp_mode_names in the driver)
+MODE_NAMES = ["normal", "noisy", "ramp", "sine", "step", "rc", "gaussian", "lut", "replay"]
+
+# Native decoding through libsimtemp (user/lib) once it has been built
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lib"))
+try:
+    import simtemp as libsimtemp
+    if not libsimtemp.available():
+        libsimtemp = None
+except ImportError:
+    libsimtemp = None
+
+
+class SampleRing:
+    """
+    Fixed-size history shared by the poll thread (writer) and the Tk
+    thread (reader). Whole batches are copied in with numpy slices; the
+    sequence numbers count what the GUI itself missed, and a batch larger
+    than the ring keeps its newest capacity samples and counts the rest
+    as lost.
+    """
+
+    def __init__(self, capacity):
+        self.temp = np.zeros(capacity, dtype=np.float32)   # °C
+        self.alert = np.zeros(capacity, dtype=bool)
+        self.capacity = capacity
+        self.total = 0          # Samples ever stored; write index = total % capacity
+        self.lost = 0
+        self.last_seq = None
+        self.lock = threading.Lock()
+
+    def push(self, temp_mC, flags, seq):
+        n = len(temp_mC)
+        if not n:
+            return
+        temp = np.asarray(temp_mC, dtype=np.float32) / 1000.0
+        alert = (np.asarray(flags) & 0x2) != 0
+        first, last = int(seq[0]), int(seq[-1])
+        if n > self.capacity:
+            temp, alert = temp[-self.capacity:], alert[-self.capacity:]
+
+        with self.lock:
+            if self.last_seq is not None:
+                self.lost += last - self.last_seq - n   # gaps before and inside the batch
+            elif last - first + 1 > n:
+                self.lost += last - first + 1 - n
+            self.last_seq = last
+
+            m = len(temp)
+            self.lost += n - m                          # clipped to the capacity
+            pos = self.total % self.capacity
+            head = min(m, self.capacity - pos)
+            self.temp[pos:pos + head] = temp[:head]
+            self.alert[pos:pos + head] = alert[:head]
+            self.temp[:m - head] = temp[head:]
+            self.alert[:m - head] = alert[head:]
+            self.total += m
+
+    def latest(self, count):
+        """Copies of the newest samples (oldest first) and the push counter."""
+        with self.lock:
+            count = min(count, self.total, self.capacity)
+            end = self.total % self.capacity
+            idx = np.arange(end - count, end) % self.capacity
+            return self.temp[idx], self.alert[idx], self.total
+
+
+def decimate(temp, alert, total, width):
+    """
+    Reduce temp to about two points per pixel column: each bucket of k
+    samples becomes its min and max, so spikes survive. Buckets are
+    aligned to absolute sample numbers (from total) so the trace does not
+    shimmer while it scrolls. Returns x (samples before the newest), y and
+    the alert mask.
+    """
+    n = len(temp)
+    x = np.arange(n) - (n - 1)
+    k = -(-n // max(int(width), 1))
+    if k < 2:
+        return x, temp, alert
+
+    skip = (-(total - n)) % k                  # first sample on a bucket boundary
+    full = (n - skip) // k * k
+    body = slice(skip, skip + full)
+    buckets = temp[body].reshape(-1, k)
+    starts = x[body][::k]
+
+    xs = np.column_stack((starts, starts + k - 1)).ravel()
+    ys = np.column_stack((buckets.min(axis=1), buckets.max(axis=1))).ravel()
+    al = np.repeat(alert[body].reshape(-1, k).any(axis=1), 2)
+
+    # Newest partial bucket as raw samples
+    tail = slice(skip + full, n)
+    return (np.concatenate((xs, x[tail])), np.concatenate((ys, temp[tail])),
+            np.concatenate((al, alert[tail])))
 
 
 class SimTempGUI:
     def __init__(self, root):
         self.root = root
-        self.root.title("SimTemp Monitor")
+        self.root.title(f"SimTemp Monitor - {DEVICE}")
 
         # Internal state
-        self.temps = []
-        self.alert_flags = []
+        self.ring = SampleRing(HISTORY)
+        self.drawn_total = 0
+        self.background = None
+        self.rate_mark = (time.monotonic(), 0)
         self.threshold_mC = self.read_sysfs("threshold_mC")
         self.mode = self.read_sysfs("mode")
         self.running = True
@@ -38,8 +148,9 @@ class SimTempGUI:
         self.thread = threading.Thread(target=self.poll_device, daemon=True)
         self.thread.start()
 
-        # Periodic stats update
+        # Periodic stats update and capped-rate redraw
         self.update_stats()
+        self.update_plot()
 
     # ---------- SYSFS HELPERS ----------
     def sysfs_path(self, name):
@@ -80,7 +191,7 @@ class SimTempGUI:
         ttk.Label(frame, text="Mode:").grid(row=2, column=0, sticky="w")
         self.mode_var = tk.StringVar(value=self.mode)
         ttk.Combobox(
-            frame, textvariable=self.mode_var, values=["normal", "noisy", "ramp"], width=10
+            frame, textvariable=self.mode_var, values=MODE_NAMES, width=10
         ).grid(row=2, column=1)
         ttk.Button(frame, text="Apply", command=self.apply_mode).grid(row=2, column=2, padx=5)
 
@@ -91,12 +202,17 @@ class SimTempGUI:
         self.figure = Figure(figsize=(6, 3), dpi=100)
         self.ax = self.figure.add_subplot(111)
         self.ax.set_title("Live Temperature")
-        self.ax.set_xlabel("Samples")
+        self.ax.set_xlabel("Samples (0 = newest)")
         self.ax.set_ylabel("Temperature (°C)")
-        self.line, = self.ax.plot([], [], "-o")
+        self.ax.set_xlim(-VIEW_SAMPLES, 0)
+        self.ax.set_ylim(0, 1)
+        # Animated artists are left out of full draws and blitted on top
+        self.line, = self.ax.plot([], [], "-", lw=1, animated=True)
+        self.alert_line, = self.ax.plot([], [], "-", lw=1.5, color="red", animated=True)
 
         self.canvas = FigureCanvasTkAgg(self.figure, master=frame)
         self.canvas.get_tk_widget().pack(fill="both", expand=True)
+        self.canvas.mpl_connect("draw_event", self.on_draw)
 
     def create_stats(self):
         frame = ttk.LabelFrame(self.root, text="Stats")
@@ -121,39 +237,82 @@ class SimTempGUI:
 
     # ---------- POLL THREAD ----------
     def poll_device(self):
-        fd = os.open(DEVICE, os.O_RDONLY | os.O_NONBLOCK)
+        if libsimtemp:
+            dev = libsimtemp.Device(DEVICE, nonblock=True, max_batch=READ_BATCH)
+            fd = dev.fileno()
+        else:
+            dev = None
+            fd = os.open(DEVICE, os.O_RDONLY | os.O_NONBLOCK)
+            fcntl.ioctl(fd, SIMTEMP_IOC_SET_ABI, struct.pack("I", SIMTEMP_ABI_V2))
         poller = select.poll()
-        poller.register(fd, select.POLLIN | select.POLLPRI)
+        poller.register(fd, select.POLLIN)
 
+        # Drain everything pending before sleeping again; the Tk thread
+        # picks the samples up from the ring at its own frame rate.
         while self.running:
-            events = poller.poll(500)
-            for _, flag in events:
-                if flag & (select.POLLIN | select.POLLPRI):
-                    data = os.read(fd, record_size)
-                    if len(data) == record_size:
-                        _, temp_mC, flags = struct.unpack(record_fmt, data)
-                        self.temps.append(temp_mC / 1000.0)
-                        self.alert_flags.append(bool(flags & 0x2))
+            if self.read_batch(dev, fd) < READ_BATCH:
+                poller.poll(100)
 
-                        if len(self.temps) > MAX_POINTS:
-                            self.temps = self.temps[-MAX_POINTS:]
-                            self.alert_flags = self.alert_flags[-MAX_POINTS:]
-
-                        self.root.after(0, self.update_plot)
+        if dev:
+            dev.close()
+        else:
+            os.close(fd)
 
-        os.close(fd)
+    def read_batch(self, dev, fd):
+        """Move up to READ_BATCH pending samples into the ring; returns how many."""
+        if dev:
+            batch = dev.read_columns()
+            temp, flags, seq = batch.temp_mC, batch.flags, batch.seq
+        else:
+            try:
+                data = os.read(fd, record_size * READ_BATCH)
+            except BlockingIOError:
+                return 0
+            rec = np.frombuffer(data, dtype=SAMPLE_DTYPE, count=len(data) // record_size)
+            temp, flags, seq = rec["temp_mC"], rec["flags"], rec["seq"]
+        self.ring.push(temp, flags, seq)
+        return len(seq)
 
     # ---------- UI UPDATES ----------
+    def on_draw(self, event):
+        # Full redraw (resize, new limits): keep the static parts for blitting
+        self.background = self.canvas.copy_from_bbox(self.ax.bbox)
+        self.blit_lines()
+
+    def blit_lines(self):
+        self.canvas.restore_region(self.background)
+        self.ax.draw_artist(self.line)
+        self.ax.draw_artist(self.alert_line)
+        self.canvas.blit(self.ax.bbox)
+
     def update_plot(self):
-        self.line.set_data(range(len(self.temps)), self.temps)
-        self.ax.set_xlim(0, MAX_POINTS)
-        if self.temps:
-            self.ax.set_ylim(min(self.temps) - 1, max(self.temps) + 1)
-        self.canvas.draw()
+        if not self.running:
+            return
+        self.root.after(FRAME_MS, self.update_plot)
+        if self.ring.total == self.drawn_total:
+            return
+
+        temp, alert, total = self.ring.latest(VIEW_SAMPLES)
+        self.drawn_total = total
+        x, y, al = decimate(temp, alert, total, self.ax.bbox.width)
+        self.line.set_data(x, y)
+        self.alert_line.set_data(x, np.where(al, y, np.nan))
+
+        # Only a change of y limits needs a full redraw
+        lo, hi = float(y.min()), float(y.max())
+        ylo, yhi = self.ax.get_ylim()
+        if lo < ylo or hi > yhi or (hi - lo + 2) * 4 < yhi - ylo:
+            self.ax.set_ylim(lo - 1, hi + 1)
+            self.canvas.draw_idle()
+        elif self.background is not None:
+            self.blit_lines()
 
     def update_stats(self):
         stats_val = self.read_sysfs("stats")
-        self.stats_text.set(stats_val)
+        now, total = time.monotonic(), self.ring.total
+        rate = (total - self.rate_mark[1]) / max(now - self.rate_mark[0], 1e-6)
+        self.rate_mark = (now, total)
+        self.stats_text.set(f"{stats_val}\nGUI: {rate:.0f} samples/s | lost: {self.ring.lost}")
         if self.running:
             self.root.after(1000, self.update_stats)  # refrescar cada 1 s
 
@@ -0,0 +1,352 @@
+/*
+ * libsimtemp - see simtemp.h
+ *
+ * The mmap path follows the consumer protocol documented in
+ * nxp_simtemp_uapi.h: load head with acquire semantics, use the records,
+ * then load head again and treat the records as overwritten if the
+ * producer got nr_samples ahead of their start in the meantime.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "simtemp.h"
+
+#define DEFAULT_BUF 4096   /* Records per read() on the read() path */
+
+struct simtemp {
+    int fd;
+    unsigned int flags;
+
+    /* read() path */
+    struct simtemp_sample *buf;
+    size_t buf_cap;
+
+    /* mmap path */
+    const struct simtemp_ring_hdr *hdr;
+    size_t map_len;
+    struct simtemp_ring_cursor *cursor;
+    const struct simtemp_sample *ring;
+    uint32_t nr;
+    uint32_t tail;
+    uint32_t span_start;         /* Counter of the last peeked span */
+
+    uint64_t last_seq;
+    int have_seq;
+};
+
+static int map_ring(struct simtemp *st)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    const struct simtemp_ring_hdr *hdr;
+    size_t len;
+
+    hdr = mmap(NULL, page, PROT_READ, MAP_SHARED, st->fd, SIMTEMP_MMAP_RING_OFF);
+    if (hdr == MAP_FAILED)
+        return -errno;
+    if (hdr->magic != SIMTEMP_RING_MAGIC || hdr->version != SIMTEMP_RING_VERSION ||
+        hdr->sample_size != sizeof(struct simtemp_sample)) {
+        munmap((void *)hdr, page);
+        return -EPROTO;
+    }
+    st->nr = hdr->nr_samples;
+    len = hdr->data_offset + (size_t)st->nr * sizeof(struct simtemp_sample);
+    munmap((void *)hdr, page);
+
+    hdr = mmap(NULL, len, PROT_READ, MAP_SHARED, st->fd, SIMTEMP_MMAP_RING_OFF);
+    if (hdr == MAP_FAILED)
+        return -errno;
+    st->cursor = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, st->fd,
+                      SIMTEMP_MMAP_CURSOR_OFF);
+    if (st->cursor == MAP_FAILED) {
+        st->cursor = NULL;
+        munmap((void *)hdr, len);
+        return -errno;
+    }
+    st->hdr = hdr;
+    st->map_len = len;
+    st->ring = (const void *)((const char *)hdr + hdr->data_offset);
+    st->tail = __atomic_load_n(&st->cursor->tail, __ATOMIC_RELAXED);
+    return 0;
+}
+
+struct simtemp *simtemp_open(const char *path, unsigned int flags)
+{
+    uint32_t abi = SIMTEMP_ABI_V2;
+    struct simtemp *st;
+    int ret;
+
+    st = calloc(1, sizeof(*st));
+    if (!st)
+        return NULL;
+    st->flags = flags;
+    st->fd = open(path, ((flags & (SIMTEMP_O_MMAP | SIMTEMP_O_WRITE)) ? O_RDWR : O_RDONLY) |
+                        ((flags & SIMTEMP_O_NONBLOCK) ? O_NONBLOCK : 0) | O_CLOEXEC);
+    if (st->fd < 0)
+        goto fail;
+    if (ioctl(st->fd, SIMTEMP_IOC_SET_ABI, &abi) < 0)
+        goto fail;
+
+    if (flags & SIMTEMP_O_MMAP) {
+        ret = map_ring(st);
+        if (ret) {
+            errno = -ret;
+            goto fail;
+        }
+    } else {
+        st->buf_cap = DEFAULT_BUF;
+        st->buf = malloc(st->buf_cap * sizeof(*st->buf));
+        if (!st->buf)
+            goto fail;
+    }
+    return st;
+
+fail:
+    ret = errno;
+    simtemp_close(st);
+    errno = ret;
+    return NULL;
+}
+
+void simtemp_close(struct simtemp *st)
+{
+    if (!st)
+        return;
+    if (st->cursor)
+        munmap(st->cursor, sysconf(_SC_PAGESIZE));
+    if (st->hdr)
+        munmap((void *)st->hdr, st->map_len);
+    if (st->fd >= 0)
+        close(st->fd);
+    free(st->buf);
+    free(st);
+}
+
+int simtemp_fd(const struct simtemp *st)
+{
+    return st->fd;
+}
+
+int simtemp_epoll_add(struct simtemp *st, int epfd, void *data)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLPRI, .data.ptr = data };
+
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, st->fd, &ev) ? -errno : 0;
+}
+
+static int wait_events(struct simtemp *st, short events, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = st->fd, .events = events };
+    int ret = poll(&pfd, 1, timeout_ms);
+
+    return ret < 0 ? -errno : ret;
+}
+
+/* 1 when samples or an event are pending, 0 on timeout */
+int simtemp_wait(struct simtemp *st, int timeout_ms)
+{
+    return wait_events(st, POLLIN | POLLPRI, timeout_ms);
+}
+
+/* ------------------------------------------------------------ */
+
+static void span_lost(struct simtemp *st, struct simtemp_span *span)
+{
+    uint64_t first = span->samples[0].seq;
+
+    span->lost = st->have_seq && first != st->last_seq + 1 ? first - st->last_seq - 1 : 0;
+}
+
+static int peek_read(struct simtemp *st, struct simtemp_span *span, size_t max)
+{
+    ssize_t n;
+
+    if (max > st->buf_cap)
+        max = st->buf_cap;
+    do {
+        n = read(st->fd, st->buf, max * sizeof(*st->buf));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return errno == EAGAIN ? 0 : -errno;
+
+    span->samples = st->buf;
+    span->count = n / sizeof(*st->buf);
+    return span->count;
+}
+
+static int peek_mmap(struct simtemp *st, struct simtemp_span *span, size_t max)
+{
+    uint32_t head, start, n, contig;
+    int ret;
+
+    for (;;) {
+        head = __atomic_load_n(&st->hdr->head, __ATOMIC_ACQUIRE);
+        if (head != st->tail)
+            break;
+        if (st->flags & SIMTEMP_O_NONBLOCK)
+            return 0;
+        /* poll() follows the mapped cursor, so it waits for new samples.
+         * POLLIN only: POLLPRI stays set until the caller dequeues the
+         * alert events, and would turn this wait into a busy loop. */
+        ret = wait_events(st, POLLIN, -1);
+        if (ret < 0 && ret != -EINTR)
+            return ret;
+    }
+
+    start = head - st->tail >= st->nr ? head - st->nr + 1 : st->tail;
+    n = head - start;
+    contig = st->nr - (start & (st->nr - 1));
+    if (n > contig)
+        n = contig;
+    if (n > max)
+        n = max;
+
+    st->span_start = start;
+    span->samples = &st->ring[start & (st->nr - 1)];
+    span->count = n;
+    return n;
+}
+
+int simtemp_peek(struct simtemp *st, struct simtemp_span *span, size_t max)
+{
+    int n;
+
+    span->count = 0;
+    span->lost = 0;
+    if (!max)
+        return 0;
+    n = (st->flags & SIMTEMP_O_MMAP) ? peek_mmap(st, span, max) : peek_read(st, span, max);
+    if (n > 0)
+        span_lost(st, span);
+    return n;
+}
+
+int simtemp_commit(struct simtemp *st, const struct simtemp_span *span)
+{
+    uint64_t last;
+    uint32_t head;
+
+    if (!span->count)
+        return 0;
+    last = span->samples[span->count - 1].seq;   /* before the lap check below */
+    if (st->flags & SIMTEMP_O_MMAP) {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&st->hdr->head, __ATOMIC_RELAXED);
+        if (head - st->span_start >= st->nr)
+            return -ESTALE;   /* the next peek skips ahead to the oldest sample */
+        st->tail = st->span_start + span->count;
+        __atomic_store_n(&st->cursor->tail, st->tail, __ATOMIC_RELEASE);
+    }
+    st->last_seq = last;
+    st->have_seq = 1;
+    return 0;
+}
+
+/* After a committed span of n samples: is nothing left to take without
+ * waiting? A short read() drained the file; the ring is drained when
+ * head caught up with the tail. */
+static int drained(struct simtemp *st, int n)
+{
+    if (!(st->flags & SIMTEMP_O_MMAP))
+        return (size_t)n < st->buf_cap;
+    return __atomic_load_n(&st->hdr->head, __ATOMIC_ACQUIRE) == st->tail;
+}
+
+int simtemp_for_each(struct simtemp *st, simtemp_cb cb, void *ctx, size_t max)
+{
+    struct simtemp_span span;
+    size_t done = 0;
+    int n;
+
+    while (done < max) {
+        n = simtemp_peek(st, &span, max - done);
+        if (n <= 0)
+            return done ? (int)done : n;
+        cb(ctx, &span);
+        if (simtemp_commit(st, &span))
+            continue;
+        done += n;
+        if (drained(st, n))
+            break;
+    }
+    return done;
+}
+
+ssize_t simtemp_read(struct simtemp *st, struct simtemp_sample *buf, size_t max)
+{
+    struct simtemp_span span;
+    int n;
+
+    do {
+        n = simtemp_peek(st, &span, max);
+        if (n <= 0)
+            return n;
+        memcpy(buf, span.samples, n * sizeof(*buf));
+    } while (simtemp_commit(st, &span) == -ESTALE);
+    return n;
+}
+
+ssize_t simtemp_read_columns(struct simtemp *st, uint64_t *timestamp_ns, int32_t *temp_mC,
+                             uint32_t *flags, uint64_t *seq, size_t max, uint64_t *lost)
+{
+    struct simtemp_span span;
+    size_t done = 0, i;
+    int n;
+
+    while (done < max) {
+        n = simtemp_peek(st, &span, max - done);
+        if (n < 0)
+            return done ? (ssize_t)done : n;
+        if (!n)
+            break;
+        for (i = 0; i < (size_t)n; i++) {
+            const struct simtemp_sample *s = &span.samples[i];
+
+            if (timestamp_ns)
+                timestamp_ns[done + i] = s->timestamp_ns;
+            if (temp_mC)
+                temp_mC[done + i] = s->temp_mC;
+            if (flags)
+                flags[done + i] = s->flags;
+            if (seq)
+                seq[done + i] = s->seq;
+        }
+        if (simtemp_commit(st, &span))
+            continue;   /* overwritten while decoding: redo from the oldest sample */
+        if (lost)
+            *lost += span.lost;
+        done += n;
+        if (drained(st, n))
+            break;
+    }
+    return done;
+}
+
+/* ------------------------------------------------------------ */
+
+int simtemp_get_event(struct simtemp *st, struct simtemp_event *ev)
+{
+    return ioctl(st->fd, SIMTEMP_IOC_GET_EVENT, ev) ? -errno : 0;
+}
+
+int simtemp_get_config(struct simtemp *st, struct simtemp_config *cfg)
+{
+    return ioctl(st->fd, SIMTEMP_IOC_GET_CONFIG, cfg) ? -errno : 0;
+}
+
+int simtemp_set_config(struct simtemp *st, const struct simtemp_config *cfg)
+{
+    return ioctl(st->fd, SIMTEMP_IOC_SET_CONFIG, cfg) ? -errno : 0;
+}
+
+int simtemp_get_stats(struct simtemp *st, struct simtemp_stats *stats)
+{
+    return ioctl(st->fd, SIMTEMP_IOC_GET_STATS, stats) ? -errno : 0;
+}
@@ -0,0 +1,94 @@
+#ifndef SIMTEMP_H
+#define SIMTEMP_H
+
+/*
+ * libsimtemp - user-space client library for /dev/simtemp
+ *
+ * Wraps the character device ABI of kernel/nxp_simtemp_uapi.h: batched
+ * read(), the mmap-ed broadcast ring, poll/epoll integration, alert
+ * events and the binary configuration ioctls. Records are always the
+ * 24-byte struct simtemp_sample (ABI v2).
+ *
+ * Zero-copy access uses peek/commit:
+ *
+ *     struct simtemp_span span;
+ *     while (simtemp_peek(st, &span, 4096) > 0) {
+ *         consume(span.samples, span.count);
+ *         if (simtemp_commit(st, &span) == -ESTALE)
+ *             discard();   // mmap only: the producer overwrote the span meanwhile
+ *     }
+ *
+ * With SIMTEMP_O_MMAP a span points straight into the shared ring; with
+ * the read() path it points into a buffer owned by the handle. A span is
+ * valid until the next call on the same handle. A handle must not be
+ * used by several threads at once; open one handle per thread instead
+ * (each one sees every sample).
+ *
+ * Functions returning int return 0 or a count on success and -errno on
+ * failure.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "nxp_simtemp_uapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* simtemp_open() flags */
+#define SIMTEMP_O_NONBLOCK 0x1   /* peek/read return 0 instead of waiting */
+#define SIMTEMP_O_MMAP     0x2   /* consume from the mmap-ed ring, no read() syscalls */
+#define SIMTEMP_O_WRITE    0x4   /* open read-write, needed by simtemp_set_config() */
+
+struct simtemp;
+
+/* A run of consecutive samples, contiguous in memory */
+struct simtemp_span {
+    const struct simtemp_sample *samples;
+    size_t count;
+    uint64_t lost;               /* Samples missed right before this span (seq gap) */
+};
+
+typedef void (*simtemp_cb)(void *ctx, const struct simtemp_span *span);
+
+/* NULL on failure, with errno set */
+struct simtemp *simtemp_open(const char *path, unsigned int flags);
+void simtemp_close(struct simtemp *st);
+
+/* File descriptor for poll()/epoll: POLLIN = samples, POLLPRI = alert event */
+int simtemp_fd(const struct simtemp *st);
+int simtemp_epoll_add(struct simtemp *st, int epfd, void *data);
+int simtemp_wait(struct simtemp *st, int timeout_ms);
+
+/* Zero-copy: up to max samples, then commit to advance past them */
+int simtemp_peek(struct simtemp *st, struct simtemp_span *span, size_t max);
+int simtemp_commit(struct simtemp *st, const struct simtemp_span *span);
+
+/* Calls cb for each span until no sample is pending or max samples were
+ * passed; returns the number of samples committed. A span the producer
+ * overwrote while cb ran is not committed (mmap only): the next span
+ * restarts at the oldest sample left, so cb may see some seq twice. */
+int simtemp_for_each(struct simtemp *st, simtemp_cb cb, void *ctx, size_t max);
+
+/* Copying variants. read_columns() splits records into separate arrays
+ * (any of which may be NULL) and adds the samples missed to *lost. */
+ssize_t simtemp_read(struct simtemp *st, struct simtemp_sample *buf, size_t max);
+ssize_t simtemp_read_columns(struct simtemp *st, uint64_t *timestamp_ns, int32_t *temp_mC,
+                             uint32_t *flags, uint64_t *seq, size_t max, uint64_t *lost);
+
+/* Alert events (-EAGAIN when none is pending on a non-blocking handle) */
+int simtemp_get_event(struct simtemp *st, struct simtemp_event *ev);
+
+/* Binary configuration and statistics */
+int simtemp_get_config(struct simtemp *st, struct simtemp_config *cfg);
+int simtemp_set_config(struct simtemp *st, const struct simtemp_config *cfg);
+int simtemp_get_stats(struct simtemp *st, struct simtemp_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMTEMP_H */
@@ -0,0 +1,184 @@
+"""
+Python bindings for libsimtemp (ctypes, standard library only).
+
+Samples are decoded by the C library into column arrays, so consumers get
+whole batches without a struct.unpack() per record:
+
+    with simtemp.Device("/dev/simtemp", nonblock=True) as dev:
+        batch = dev.read_columns()
+        print(batch.seq[-1], batch.temp_mC[-1])
+
+Columns are memoryviews into arrays owned by the Device and are
+overwritten by the next read_columns() call; copy them (list(), bytes(),
+numpy.frombuffer(...).copy()) to keep them.
+
+The library is looked up in $SIMTEMP_LIB, next to this file (after
+`make -C user/lib`) and in the system library path.
+"""
+import os
+import errno
+import array
+import ctypes
+import ctypes.util
+from collections import namedtuple
+
+O_NONBLOCK = 0x1
+O_MMAP = 0x2
+O_WRITE = 0x4
+
+READ_MAX = 4096
+
+Columns = namedtuple("Columns", "timestamp_ns temp_mC flags seq lost")
+
+
+class Event(ctypes.Structure):
+    _fields_ = [("timestamp_ns", ctypes.c_uint64), ("temp_mC", ctypes.c_int32),
+                ("type", ctypes.c_uint32), ("seq", ctypes.c_uint64),
+                ("lost", ctypes.c_uint32), ("reserved", ctypes.c_uint32)]
+
+
+class Config(ctypes.Structure):
+    _fields_ = [("period_ns", ctypes.c_uint64), ("wakeup_timeout_ns", ctypes.c_uint64),
+                ("agg_window_ns", ctypes.c_uint64), ("threshold_mC", ctypes.c_int32),
+                ("threshold_low_mC", ctypes.c_int32), ("mode", ctypes.c_uint32),
+                ("gen_context", ctypes.c_uint32), ("cpu", ctypes.c_int32),
+                ("batch", ctypes.c_uint32), ("wakeup_watermark", ctypes.c_uint32),
+                ("reserved", ctypes.c_uint32 * 9)]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in
+                ("updates", "alerts", "missed", "coalesced", "dropped", "high_water", "seq",
+                 "consumed", "wakeups", "overruns", "lat_min_ns", "lat_max_ns")] + \
+               [("last_error", ctypes.c_uint32), ("reserved", ctypes.c_uint32 * 5)]
+
+
+_lib = None
+
+
+def load():
+    """Load libsimtemp once; raises OSError when it cannot be found."""
+    global _lib
+    if _lib:
+        return _lib
+
+    here = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libsimtemp.so")
+    candidates = [os.environ.get("SIMTEMP_LIB"), here, ctypes.util.find_library("simtemp")]
+    for path in filter(None, candidates):
+        if os.path.sep not in path or os.path.exists(path):
+            try:
+                lib = ctypes.CDLL(path, use_errno=True)
+                break
+            except OSError:
+                continue
+    else:
+        raise OSError("libsimtemp not found (build it with: make -C user/lib)")
+
+    vp, sz, u64p = ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint64)
+    lib.simtemp_open.restype = vp
+    lib.simtemp_open.argtypes = [ctypes.c_char_p, ctypes.c_uint]
+    lib.simtemp_close.argtypes = [vp]
+    lib.simtemp_fd.argtypes = [vp]
+    lib.simtemp_wait.argtypes = [vp, ctypes.c_int]
+    lib.simtemp_read_columns.restype = ctypes.c_ssize_t
+    lib.simtemp_read_columns.argtypes = [vp, vp, vp, vp, vp, sz, u64p]
+    lib.simtemp_get_event.argtypes = [vp, ctypes.POINTER(Event)]
+    lib.simtemp_get_config.argtypes = [vp, ctypes.POINTER(Config)]
+    lib.simtemp_set_config.argtypes = [vp, ctypes.POINTER(Config)]
+    lib.simtemp_get_stats.argtypes = [vp, ctypes.POINTER(Stats)]
+    _lib = lib
+    return lib
+
+
+def available():
+    """True when the native library can be loaded."""
+    try:
+        load()
+        return True
+    except OSError:
+        return False
+
+
+def _check(ret):
+    if ret < 0:
+        raise OSError(-ret, os.strerror(-ret))
+    return ret
+
+
+class Device:
+    """One handle on a simtemp node; sees every sample (broadcast ring)."""
+
+    def __init__(self, path="/dev/simtemp", nonblock=False, use_mmap=False, max_batch=READ_MAX,
+                 writable=False):
+        self._h = None
+        self._lib = load()
+        flags = (O_NONBLOCK if nonblock else 0) | (O_MMAP if use_mmap else 0) | \
+            (O_WRITE if writable else 0)
+        self._h = self._lib.simtemp_open(path.encode(), flags)
+        if not self._h:
+            err = ctypes.get_errno()
+            raise OSError(err, os.strerror(err), path)
+        self.max_batch = max_batch
+        self._ts = array.array("Q", bytes(8 * max_batch))
+        self._temp = array.array("i", bytes(4 * max_batch))
+        self._flags = array.array("I", bytes(4 * max_batch))
+        self._seq = array.array("Q", bytes(8 * max_batch))
+
+    def fileno(self):
+        """For poll()/select()/selectors: POLLIN = samples, POLLPRI = alert event."""
+        return self._lib.simtemp_fd(self._h)
+
+    def wait(self, timeout_ms=-1):
+        """True when samples or an event are pending."""
+        return _check(self._lib.simtemp_wait(self._h, timeout_ms)) > 0
+
+    def read_columns(self, max_samples=None):
+        """
+        Return up to max_samples samples as Columns of memoryviews, decoded
+        in C. Empty columns mean nothing was pending (non-blocking handle).
+        lost is the number of samples missed before this batch.
+        """
+        n = min(max_samples or self.max_batch, self.max_batch)
+        lost = ctypes.c_uint64(0)
+        n = _check(self._lib.simtemp_read_columns(
+            self._h, self._ts.buffer_info()[0], self._temp.buffer_info()[0],
+            self._flags.buffer_info()[0], self._seq.buffer_info()[0], n, ctypes.byref(lost)))
+        return Columns(memoryview(self._ts)[:n], memoryview(self._temp)[:n],
+                       memoryview(self._flags)[:n], memoryview(self._seq)[:n], lost.value)
+
+    def get_event(self):
+        """Next alert event, or None when none is pending (non-blocking handle)."""
+        ev = Event()
+        ret = self._lib.simtemp_get_event(self._h, ctypes.byref(ev))
+        if ret == -errno.EAGAIN:
+            return None
+        _check(ret)
+        return ev
+
+    def get_config(self):
+        cfg = Config()
+        _check(self._lib.simtemp_get_config(self._h, ctypes.byref(cfg)))
+        return cfg
+
+    def set_config(self, cfg):
+        _check(self._lib.simtemp_set_config(self._h, ctypes.byref(cfg)))
+
+    def get_stats(self):
+        """Counters of struct simtemp_stats as a dict."""
+        st = Stats()
+        _check(self._lib.simtemp_get_stats(self._h, ctypes.byref(st)))
+        return {name: getattr(st, name) for name, _ in Stats._fields_ if name != "reserved"}
+
+    def close(self):
+        if getattr(self, "_h", None):
+            self._lib.simtemp_close(self._h)
+            self._h = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
@@ -0,0 +1,217 @@
+"""
+Binary recordings of the simtemp sample stream (standard library only).
+
+A recording is a file header followed by chunks. Each chunk holds the
+samples of one or more reads as four columns, so they are written and
+read back with whole-array copies instead of one struct call per sample:
+
+    file header  "=4sHHqq"  magic b"STRC", version, reserved,
+                            wall_ns (CLOCK_REALTIME) and mono_ns
+                            (CLOCK_MONOTONIC) taken together at creation
+    chunk header "=4sIIII"  magic b"CHNK", count, codec, payload length,
+                            crc32 of the uncompressed payload
+    payload                 timestamp_ns u64[count] | temp_mC s32[count] |
+                            flags u32[count] | seq u64[count],
+                            native byte order, compressed by codec
+
+timestamp_ns is the driver's CLOCK_MONOTONIC stamp; wall time of a sample
+is wall_ns + (timestamp_ns - mono_ns). Rotated recordings are independent
+files named <stem>.NNNN<ext>.
+
+    with Recorder("run.strec", codec="zlib") as rec:
+        rec.write(ts, temp, flags, seq)      # columns of one batch
+
+    for chunk in read_chunks("run.strec"):
+        print(len(chunk.seq), max(chunk.temp_mC))
+"""
+import os
+import lzma
+import time
+import zlib
+import array
+import queue
+import struct
+import threading
+from collections import namedtuple
+
+FILE_MAGIC = b"STRC"
+CHUNK_MAGIC = b"CHNK"
+VERSION = 1
+FILE_HDR = struct.Struct("=4sHHqq")
+CHUNK_HDR = struct.Struct("=4sIIII")
+
+CODECS = {"none": 0, "zlib": 1, "lzma": 2}
+
+# (typecode, field) per column, in payload order
+COLUMNS = (("Q", "timestamp_ns"), ("i", "temp_mC"), ("I", "flags"), ("Q", "seq"))
+
+Chunk = namedtuple("Chunk", [name for _, name in COLUMNS])
+Header = namedtuple("Header", "version wall_ns mono_ns")
+
+
+def _compress(codec, data, level):
+    if codec == 1:
+        return zlib.compress(data, level)
+    if codec == 2:
+        return lzma.compress(data, preset=level)
+    return data
+
+
+def _decompress(codec, data):
+    if codec == 1:
+        return zlib.decompress(data)
+    if codec == 2:
+        return lzma.decompress(data)
+    if codec == 0:
+        return data
+    raise ValueError(f"unknown codec {codec}")
+
+
+class Recorder:
+    """
+    Buffered, rotating writer. write() only appends to in-memory columns;
+    full chunks are compressed and written by a background thread, so the
+    caller can keep draining the device while the disk catches up.
+    close() flushes everything.
+    """
+
+    def __init__(self, path, codec="zlib", level=1, rotate_bytes=0,
+                 chunk_samples=1 << 16, flush_s=1.0, queue_chunks=16):
+        self.codec = CODECS[codec]
+        self.level = level
+        self.rotate_bytes = rotate_bytes
+        self.chunk_samples = chunk_samples
+        self.flush_s = flush_s
+        stem, ext = os.path.splitext(path)
+        self.names = (f"{stem}.{i:04d}{ext}" for i in range(10000)) if rotate_bytes else iter([path])
+        self.files = []
+        self.bytes_written = 0
+        self.samples = 0
+        self.error = None
+
+        self.cols = [bytearray() for _ in COLUMNS]
+        self.count = 0
+        self.started = time.monotonic()
+
+        self.file = None
+        self._open_next()
+        self.queue = queue.Queue(queue_chunks)   # bounded: write() blocks if the disk falls far behind
+        self.thread = threading.Thread(target=self._writer, daemon=True)
+        self.thread.start()
+
+    def _open_next(self):
+        if self.file:
+            self.file.close()
+        name = next(self.names)
+        self.file = open(name, "wb", buffering=1 << 20)
+        self.file.write(FILE_HDR.pack(FILE_MAGIC, VERSION, 0, time.time_ns(),
+                                      time.clock_gettime_ns(time.CLOCK_MONOTONIC)))
+        self.file_bytes = FILE_HDR.size
+        self.files.append(name)
+
+    def _writer(self):
+        while True:
+            item = self.queue.get()
+            if item is None:
+                break
+            count, payload = item
+            try:
+                data = _compress(self.codec, payload, self.level)
+                if self.rotate_bytes and self.file_bytes > FILE_HDR.size and \
+                        self.file_bytes + CHUNK_HDR.size + len(data) > self.rotate_bytes:
+                    self._open_next()
+                self.file.write(CHUNK_HDR.pack(CHUNK_MAGIC, count, self.codec, len(data),
+                                               zlib.crc32(payload)))
+                self.file.write(data)
+                self.file_bytes += CHUNK_HDR.size + len(data)
+                self.bytes_written += CHUNK_HDR.size + len(data)
+            except OSError as e:
+                self.error = e
+
+    def write(self, timestamp_ns, temp_mC, flags, seq):
+        """Append one batch of columns (memoryviews, arrays or sequences)."""
+        if self.error:
+            raise self.error
+        for (code, _), col, buf in zip(COLUMNS, (timestamp_ns, temp_mC, flags, seq), self.cols):
+            if not isinstance(col, (memoryview, array.array)):
+                col = array.array(code, col)
+            buf += col
+        self.count += len(seq)
+        self.samples += len(seq)
+        if self.count >= self.chunk_samples or time.monotonic() - self.started >= self.flush_s:
+            self.flush()
+
+    def flush(self):
+        """Queue the pending samples as one chunk."""
+        if self.count:
+            self.queue.put((self.count, b"".join(self.cols)))
+            self.cols = [bytearray() for _ in COLUMNS]
+            self.count = 0
+        self.started = time.monotonic()
+
+    def close(self):
+        self.flush()
+        self.queue.put(None)
+        self.thread.join()
+        self.file.close()
+        if self.error:
+            raise self.error
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+def read_header(f):
+    magic, version, _, wall_ns, mono_ns = FILE_HDR.unpack(f.read(FILE_HDR.size))
+    if magic != FILE_MAGIC or version != VERSION:
+        raise ValueError("not a simtemp recording")
+    return Header(version, wall_ns, mono_ns)
+
+
+def is_recording(path):
+    with open(path, "rb") as f:
+        return f.read(len(FILE_MAGIC)) == FILE_MAGIC
+
+
+def read_chunks(path, header=None):
+    """
+    Yield the chunks of a recording as Chunk columns (array.array). When
+    header is a list, the file Header is appended to it first.
+    """
+    with open(path, "rb", buffering=1 << 20) as f:
+        hdr = read_header(f)
+        if header is not None:
+            header.append(hdr)
+        while True:
+            raw = f.read(CHUNK_HDR.size)
+            if not raw:
+                return
+            if len(raw) < CHUNK_HDR.size:
+                raise ValueError(f"{path}: truncated chunk header")
+            magic, count, codec, length, crc = CHUNK_HDR.unpack(raw)
+            if magic != CHUNK_MAGIC:
+                raise ValueError(f"{path}: bad chunk magic")
+            payload = _decompress(codec, f.read(length))
+            if zlib.crc32(payload) != crc:
+                raise ValueError(f"{path}: chunk checksum mismatch")
+
+            cols, off = [], 0
+            for code, _ in COLUMNS:
+                col = array.array(code)
+                size = col.itemsize * count
+                col.frombytes(payload[off:off + size])
+                cols.append(col)
+                off += size
+            yield Chunk(*cols)
+
+
+def to_records(chunk, fmt="=QiIQ"):
+    """Interleave a chunk back into raw v2 records (e.g. for the replay mode)."""
+    rec = struct.Struct(fmt)
+    out = bytearray(rec.size * len(chunk.seq))
+    for i, row in enumerate(zip(*chunk)):
+        rec.pack_into(out, i * rec.size, *row)
+    return bytes(out)